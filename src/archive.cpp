@@ -0,0 +1,151 @@
+#include "archive.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+static const char ArchiveMagic[] = "!<arch>\n";
+static const char ThinArchiveMagic[] = "!<thin>\n";
+static const size_t ArchiveMagicSize = sizeof(ArchiveMagic) - 1;
+
+struct ArchiveMemberHeader {
+	char name[16];
+	char date[12];
+	char uid[6];
+	char gid[6];
+	char mode[8];
+	char size[10];
+	char fmag[2];
+};
+
+static std::string trim_field(const char *field, size_t size) {
+	while (size && field[size - 1] == ' ')
+		--size;
+	return std::string(field, size);
+}
+
+static size_t parse_decimal(const char *field, size_t size) {
+	std::string value = trim_field(field, size);
+	char *end;
+	unsigned long long n = strtoull(value.c_str(), &end, 10);
+	if (value.empty() || *end)
+		throw std::runtime_error("Malformed archive member header");
+	return n;
+}
+
+static uint64_t read_be(const char *p, size_t size) {
+	uint64_t value = 0;
+	for (size_t i = 0; i < size; ++i)
+		value = (value << 8) | static_cast<unsigned char>(p[i]);
+	return value;
+}
+
+Archive::Archive(const char *data_, size_t size_):
+	data(data_),
+	size(size_)
+{
+	if (!IsArchive(data, size))
+		throw std::runtime_error("Not an archive");
+	if (memcmp(data, ThinArchiveMagic, ArchiveMagicSize) == 0)
+		throw std::runtime_error("Thin archives are not supported");
+
+	const char *index = nullptr, *long_names = nullptr;
+	size_t index_size = 0, index_entry_size = 0, long_names_size = 0;
+	std::map<size_t, size_t> member_by_offset;
+
+	size_t offset = ArchiveMagicSize;
+	while (offset < size) {
+		if (size - offset < sizeof(ArchiveMemberHeader))
+			throw std::runtime_error("Truncated archive member header");
+		auto header = reinterpret_cast<const ArchiveMemberHeader*>(data + offset);
+		if (header->fmag[0] != '`' || header->fmag[1] != '\n')
+			throw std::runtime_error("Malformed archive member header");
+
+		size_t member_size = parse_decimal(header->size, sizeof(header->size));
+		size_t data_offset = offset + sizeof(ArchiveMemberHeader);
+		if (member_size > size - data_offset)
+			throw std::runtime_error("Truncated archive member");
+		const char *member_data = data + data_offset;
+		// members are aligned to an even offset, the last one may lack the padding byte
+		size_t next_offset = data_offset + member_size + (member_size & 1);
+
+		std::string name = trim_field(header->name, sizeof(header->name));
+		if (name == "/" || name == "/SYM64/") {
+			index = member_data;
+			index_size = member_size;
+			index_entry_size = name == "/" ? 4 : 8;
+		} else if (name == "//") {
+			long_names = member_data;
+			long_names_size = member_size;
+		} else if (name == "__.SYMDEF" || name == "__.SYMDEF SORTED") {
+			// BSD ranlib index, it carries nothing we need for the scan
+		} else {
+			if (name.compare(0, 3, "#1/") == 0) {
+				// BSD: name of the given length is stored in front of member data
+				size_t name_size = parse_decimal(name.c_str() + 3, name.size() - 3);
+				if (name_size > member_size)
+					throw std::runtime_error("Malformed archive member name");
+				name.assign(member_data, strnlen(member_data, name_size));
+				member_data += name_size;
+				member_size -= name_size;
+			} else if (name.size() > 1 && name[0] == '/') {
+				// GNU: "/123" is an offset into the "//" long-name table
+				size_t name_offset = parse_decimal(name.c_str() + 1, name.size() - 1);
+				if (!long_names || name_offset >= long_names_size)
+					throw std::runtime_error("Archive member name is outside of the long-name table");
+				const char *begin = long_names + name_offset;
+				const char *end = static_cast<const char*>(memchr(begin, '\n', long_names_size - name_offset));
+				if (!end)
+					end = long_names + long_names_size;
+				name.assign(begin, end);
+				if (!name.empty() && name.back() == '/')
+					name.pop_back();
+			} else if (name.size() > 1 && name.back() == '/') {
+				name.pop_back();
+			}
+
+			member_by_offset[offset] = members.size();
+			members.push_back(Member{name, offset, member_data, member_size});
+		}
+
+		offset = next_offset;
+	}
+
+	if (index) {
+		ReadSymbolIndex(index, index_size, index_entry_size);
+		for (auto &symbol : symbols) {
+			auto member = member_by_offset.find(symbol.member);
+			if (member == member_by_offset.end())
+				throw std::runtime_error("Archive symbol index refers to a missing member");
+			symbol.member = member->second;
+		}
+	}
+}
+
+bool Archive::IsArchive(const char *data, size_t size) {
+	return size >= ArchiveMagicSize
+		&& (memcmp(data, ArchiveMagic, ArchiveMagicSize) == 0 || memcmp(data, ThinArchiveMagic, ArchiveMagicSize) == 0);
+}
+
+// Fills `symbols` with member header offsets, which the caller maps to member indices
+void Archive::ReadSymbolIndex(const char *index, size_t index_size, size_t entry_size) {
+	if (index_size < entry_size)
+		throw std::runtime_error("Truncated archive symbol index");
+	uint64_t count = read_be(index, entry_size);
+	if (count > (index_size - entry_size) / entry_size)
+		throw std::runtime_error("Truncated archive symbol index");
+
+	const char *offsets = index + entry_size;
+	const char *names = offsets + count * entry_size;
+	const char *names_end = index + index_size;
+	symbols.reserve(count);
+	for (uint64_t i = 0; i < count; ++i) {
+		const char *end = static_cast<const char*>(memchr(names, '\0', names_end - names));
+		if (!end)
+			throw std::runtime_error("Truncated archive symbol index");
+		symbols.push_back(Symbol{std::string(names, end), static_cast<size_t>(read_be(offsets + i * entry_size, entry_size))});
+		names = end + 1;
+	}
+}
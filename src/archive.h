@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Parser for `ar` static archives
+ *
+ * Works in place over a buffer owned by the caller (usually a MappedFile):
+ * members are described by pointers into that buffer, nothing is copied.
+ * Understands GNU/SysV archives (`/` and `/SYM64/` symbol index, `//`
+ * long-name table) as well as BSD `#1/len` member names.
+ */
+class Archive {
+public:
+	struct Member {
+		std::string name;
+		size_t offset; // offset of the member header within the archive
+		const char *data;
+		size_t size;
+	};
+
+	struct Symbol {
+		std::string name;
+		size_t member; // index into Members()
+	};
+
+	Archive(const char *data_, size_t size_);
+	// Thin archives count too, so that opening one reports them as unsupported
+	static bool IsArchive(const char *data, size_t size);
+	const std::vector<Member> &Members() const { return members; }
+	const std::vector<Symbol> &Symbols() const { return symbols; }
+private:
+	void ReadSymbolIndex(const char *index, size_t index_size, size_t entry_size);
+	const char *data;
+	size_t size;
+	std::vector<Member> members;
+	std::vector<Symbol> symbols;
+};
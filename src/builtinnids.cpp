@@ -0,0 +1,83 @@
+#include "builtinnids.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "utility.h"
+
+#ifdef VITALINK_BUILTIN_NIDS
+
+// Generated at build time, defines builtin_modules[] and builtin_functions[]
+// (each followed by one terminating entry) and their counts
+#include "builtin_nids_table.h"
+
+namespace {
+
+/**
+ * \brief Lookups in the tables compiled into the binary
+ *
+ * Functions are sorted by (name hash, name, database order) like in a
+ * compiled database, so a lookup is the same binary search with nothing
+ * to open or parse first.
+ */
+class BuiltinNidDb : public NidDatabase {
+public:
+	bool Lookup(const std::string &name, NidMatch *match) const override {
+		uint32_t hash = hash_name(name.data(), name.size());
+		const BuiltinNidFunction *end = builtin_functions + builtin_function_count;
+		const BuiltinNidFunction *function = std::lower_bound(builtin_functions, end, hash,
+			[](const BuiltinNidFunction &f, uint32_t h) { return f.hash < h; });
+		for (; function != end && function->hash == hash; ++function) {
+			if (function->name_length != name.size() || memcmp(function->name, name.data(), name.size()) != 0)
+				continue;
+			const BuiltinNidModule &module = builtin_modules[function->module];
+			match->module_name.assign(module.name, module.name_length);
+			match->module_nid = module.nid;
+			match->nid = function->nid;
+			return true;
+		}
+		return false;
+	}
+};
+
+}
+
+std::unique_ptr<NidDatabase> builtin_nid_database() {
+	return std::unique_ptr<NidDatabase>(new BuiltinNidDb);
+}
+
+std::vector<NidModule> builtin_nid_modules() {
+	std::vector<NidModule> modules(builtin_module_count);
+	for (size_t i = 0; i < builtin_module_count; ++i) {
+		modules[i].name.assign(builtin_modules[i].name, builtin_modules[i].name_length);
+		modules[i].nid = builtin_modules[i].nid;
+	}
+	for (size_t i = 0; i < builtin_function_count; ++i) {
+		auto &function = builtin_functions[i];
+		modules[function.module].functions.push_back(NidFunction{std::string(function.name, function.name_length), function.nid});
+	}
+	return modules;
+}
+
+#else
+
+std::unique_ptr<NidDatabase> builtin_nid_database() {
+	return nullptr;
+}
+
+std::vector<NidModule> builtin_nid_modules() {
+	return std::vector<NidModule>();
+}
+
+#endif
+
+std::unique_ptr<NidDatabase> require_builtin_nid_database() {
+	auto db = builtin_nid_database();
+	if (!db) {
+		std::cerr << "This vitalink was built without a NID database, configure it with -DVITALINK_BUILTIN_NIDS=nids.xml" << std::endl;
+		exit(1);
+	}
+	return db;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "niddb.h"
+
+// Records of the table generated by nidgen
+struct BuiltinNidModule {
+	const char *name;
+	uint32_t name_length;
+	uint32_t nid;
+};
+
+struct BuiltinNidFunction {
+	uint32_t hash;
+	const char *name;
+	uint32_t name_length;
+	uint32_t module;
+	uint32_t nid;
+};
+
+// The database compiled into vitalink with -DVITALINK_BUILTIN_NIDS=nids.xml,
+// or nullptr if there is none
+std::unique_ptr<NidDatabase> builtin_nid_database();
+// Like builtin_nid_database, but explains how to get one and exits if there is none
+std::unique_ptr<NidDatabase> require_builtin_nid_database();
+// The same database as a list of modules, empty if there is none
+std::vector<NidModule> builtin_nid_modules();
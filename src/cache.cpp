@@ -0,0 +1,116 @@
+#include "cache.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include "utility.h"
+
+static const char CacheHeader[] = "vitalink-cache 3";
+
+FileStamp stamp_file(const std::string &path) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		throw std::runtime_error("Cannot open input file for reading.");
+#ifdef __APPLE__
+	uint64_t nsec = st.st_mtimespec.tv_nsec;
+#else
+	uint64_t nsec = st.st_mtim.tv_nsec;
+#endif
+	return FileStamp{static_cast<uint64_t>(st.st_size), static_cast<uint64_t>(st.st_mtime) * 1000000000u + nsec};
+}
+
+/*
+ * The cache is a text file:
+ *
+ *   vitalink-cache 3 <options>
+ *   <size> <mtime> <undefined count> <defined count> <weak count> <name>
+ *   <undefined symbol>
+ *   ...
+ *   <defined symbol>
+ *   ...
+ *   <weak symbol>
+ *   ...
+ *
+ * An unreadable or outdated cache is silently treated as empty.
+ */
+ScanCache::ScanCache(const std::string &path_, const std::string &options_):
+	path(path_),
+	header(std::string(CacheHeader) + " " + options_)
+{
+	try {
+		if (!Load())
+			entries.clear();
+	} catch (const std::exception &) {
+		// e.g. std::bad_alloc for a garbled entry
+		entries.clear();
+	}
+}
+
+// Returns false if the cache is missing, outdated or malformed
+bool ScanCache::Load() {
+	std::ifstream input(path.c_str(), std::ios::in);
+	std::string line;
+	if (!std::getline(input, line) || line != header)
+		return false;
+
+	while (std::getline(input, line)) {
+		std::istringstream fields(line);
+		Entry entry;
+		size_t counts[3];
+		std::string name;
+		if (!(fields >> entry.stamp.size >> entry.stamp.mtime >> counts[0] >> counts[1] >> counts[2])
+				|| !std::getline(fields >> std::ws, name))
+			return false;
+
+		// the counts are not trusted for allocating, a short file simply runs out of lines
+		std::vector<std::string> *lists[] = { &entry.symbols.undefined, &entry.symbols.defined, &entry.symbols.weak };
+		for (int i = 0; i < 3; ++i)
+			for (size_t j = 0; j < counts[i]; ++j) {
+				if (!std::getline(input, line))
+					return false;
+				lists[i]->push_back(line);
+			}
+		entry.used = false;
+		entries[name] = std::move(entry);
+	}
+	return true;
+}
+
+bool ScanCache::Find(const std::string &name, const FileStamp &stamp, CachedSymbols *symbols) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = entries.find(name);
+	if (entry == entries.end() || !(entry->second.stamp == stamp))
+		return false;
+	entry->second.used = true;
+	*symbols = entry->second.symbols;
+	return true;
+}
+
+void ScanCache::Store(const std::string &name, const FileStamp &stamp, CachedSymbols symbols) {
+	// a name we could not read back is not worth caching
+	if (name.find('\n') != std::string::npos)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	entries[name] = Entry{stamp, std::move(symbols), true};
+}
+
+void ScanCache::Save() {
+	std::string output = header + "\n";
+	for (auto &entry : entries) {
+		if (!entry.second.used)
+			continue;
+		auto &symbols = entry.second.symbols;
+		output += std::to_string(entry.second.stamp.size) + " " + std::to_string(entry.second.stamp.mtime) + " "
+			+ std::to_string(symbols.undefined.size()) + " " + std::to_string(symbols.defined.size()) + " "
+			+ std::to_string(symbols.weak.size()) + " " + entry.first + "\n";
+		for (auto list : { &symbols.undefined, &symbols.defined, &symbols.weak })
+			for (auto &symbol : *list)
+				output += symbol + "\n";
+	}
+	write_file_atomic(path, output);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct FileStamp {
+	uint64_t size;
+	uint64_t mtime; // nanoseconds
+
+	bool operator==(const FileStamp &other) const { return size == other.size && mtime == other.mtime; }
+};
+
+// The symbol names of one object, sorted
+struct CachedSymbols {
+	std::vector<std::string> undefined;
+	std::vector<std::string> defined;
+	std::vector<std::string> weak;
+};
+
+// Throws if `path` cannot be stat'ed
+FileStamp stamp_file(const std::string &path);
+
+/**
+ * \brief On-disk cache of the symbols of every scanned object
+ *
+ * Entries are keyed by object name (`path` or `archive(member@offset)`) and
+ * invalidated by the size and modification time of the file they came
+ * from. `options_` names the scan settings the symbols depend on, a cache
+ * written with different ones is discarded. Only entries that were used or
+ * added during this run are saved, so objects removed from the build drop
+ * out of the cache. All methods except Save() may be called from several
+ * threads.
+ */
+class ScanCache {
+public:
+	ScanCache(const std::string &path_, const std::string &options_);
+	bool Find(const std::string &name, const FileStamp &stamp, CachedSymbols *symbols);
+	void Store(const std::string &name, const FileStamp &stamp, CachedSymbols symbols);
+	void Save();
+private:
+	bool Load();
+	struct Entry {
+		FileStamp stamp;
+		CachedSymbols symbols;
+		bool used;
+	};
+
+	std::string path;
+	std::string header;
+	std::mutex mutex;
+	std::unordered_map<std::string, Entry> entries;
+};
@@ -0,0 +1,112 @@
+#include "derive.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#include "mappedfile.h"
+#include "sha1.h"
+#include "utility.h"
+
+// Names per parallel_for task, and per sha1_batch call
+static const size_t DeriveBatch = 1024;
+
+NidDeriveRule parse_derive_rule(const std::string &spec) {
+	std::vector<std::string> fields;
+	size_t start = 0;
+	for (;;) {
+		size_t colon = spec.find(':', start);
+		// the prefix is last and may contain colons itself
+		if (colon == std::string::npos || fields.size() == 3) {
+			fields.push_back(spec.substr(start));
+			break;
+		}
+		fields.push_back(spec.substr(start, colon - start));
+		start = colon + 1;
+	}
+	if (fields.size() < 3 || fields[0].empty())
+		throw std::runtime_error("Invalid NID derivation rule " + spec + ", expected MODULE:MODULE_NID:SUFFIX[:PREFIX]");
+
+	NidDeriveRule rule;
+	rule.module_name = fields[0];
+	if (!parse_hex_nid(fields[1].data(), fields[1].size(), &rule.module_nid))
+		throw std::runtime_error("Invalid module NID " + fields[1]);
+
+	const std::string &suffix = fields[2];
+	if (suffix.compare(0, 2, "0x") == 0) {
+		if (suffix.size() % 2)
+			throw std::runtime_error("Odd number of hex digits in suffix " + suffix);
+		for (size_t i = 2; i < suffix.size(); i += 2) {
+			int high = hex_digit(suffix[i]), low = hex_digit(suffix[i + 1]);
+			if (high < 0 || low < 0)
+				throw std::runtime_error("Invalid hex suffix " + suffix);
+			rule.suffix.push_back(static_cast<char>((high << 4) | low));
+		}
+	} else {
+		rule.suffix = suffix;
+	}
+	if (fields.size() > 3)
+		rule.prefix = fields[3];
+	return rule;
+}
+
+static uint32_t digest_nid(const Sha1Digest &digest) {
+	return digest.bytes[0] | (digest.bytes[1] << 8) | (digest.bytes[2] << 16) | (uint32_t(digest.bytes[3]) << 24);
+}
+
+uint32_t derive_nid(const std::string &name, const std::string &suffix) {
+	std::string message = name + suffix;
+	return digest_nid(sha1(message.data(), message.size()));
+}
+
+std::vector<uint32_t> derive_nids(const std::vector<std::string> &names, const std::string &suffix, unsigned jobs) {
+	std::vector<uint32_t> nids(names.size());
+	parallel_for((names.size() + DeriveBatch - 1) / DeriveBatch, jobs, [&](size_t task, unsigned) {
+		size_t first = task * DeriveBatch;
+		size_t count = std::min(DeriveBatch, names.size() - first);
+		std::vector<std::string> messages(count);
+		for (size_t i = 0; i < count; ++i)
+			messages[i] = names[first + i] + suffix;
+		std::vector<Sha1Digest> digests(count);
+		sha1_batch(messages.data(), count, digests.data());
+		for (size_t i = 0; i < count; ++i)
+			nids[first + i] = digest_nid(digests[i]);
+	});
+	return nids;
+}
+
+void write_derived_nids(const NidDeriveRule &rule, const std::string &names_path, const std::string &output_path, unsigned jobs) {
+	std::vector<std::string> names;
+	try {
+		MappedFile file(names_path);
+		const char *p = file.Data(), *end = p + file.Size();
+		while (p < end) {
+			const char *line_end = std::find(p, end, '\n');
+			const char *name_end = line_end;
+			while (name_end > p && (name_end[-1] == '\r' || name_end[-1] == ' ' || name_end[-1] == '\t'))
+				--name_end;
+			while (p < name_end && (*p == ' ' || *p == '\t'))
+				++p;
+			std::string name(p, name_end);
+			if (!name.empty() && name[0] != '#' && name.compare(0, rule.prefix.size(), rule.prefix) == 0)
+				names.push_back(name);
+			p = line_end + (line_end < end);
+		}
+	} catch (const std::runtime_error &e) {
+		throw std::runtime_error(names_path + ": " + e.what());
+	}
+
+	auto nids = derive_nids(names, rule.suffix, jobs);
+	std::string output;
+	char buf[32];
+	snprintf(buf, sizeof(buf), "0x%08X ", rule.module_nid);
+	std::string module = buf + rule.module_name + " ";
+	for (size_t i = 0; i < names.size(); ++i) {
+		snprintf(buf, sizeof(buf), "0x%08X ", nids[i]);
+		output += module;
+		output += buf;
+		output += names[i];
+		output += '\n';
+	}
+	write_file_atomic(output_path, output);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Where NIDs can be computed rather than looked up
+ *
+ * A function NID is the first four bytes (little-endian) of the SHA-1 of
+ * its name followed by a suffix that is fixed for the whole library.
+ */
+struct NidDeriveRule {
+	std::string module_name;
+	uint32_t module_nid;
+	std::string suffix;
+	std::string prefix; // only names starting with this are derived
+};
+
+// Parses MODULE:MODULE_NID:SUFFIX[:PREFIX]. A suffix starting with 0x is
+// given as hex bytes, otherwise it is taken literally.
+NidDeriveRule parse_derive_rule(const std::string &spec);
+
+uint32_t derive_nid(const std::string &name, const std::string &suffix);
+// The NIDs of many names at once, on up to `jobs` threads
+std::vector<uint32_t> derive_nids(const std::vector<std::string> &names, const std::string &suffix, unsigned jobs = 1);
+
+// Reads one name per line from `names_path` and writes the matching entries
+// of `rule`'s module to `output_path` as a text database (see nidtext.h).
+// Error messages name the file that could not be read or written.
+void write_derived_nids(const NidDeriveRule &rule, const std::string &names_path, const std::string &output_path, unsigned jobs = 1);
@@ -1,68 +1,97 @@
 #include "elf.h"
 
+#include <algorithm>
 #include <cstring>
-#include <fstream>
 #include <stdexcept>
 #include <utility>
 
 #include <iostream>
 
 #include "elftypes.h"
+#include "symfilter.h"
 #include "vitastructs.h"
 #include "utility.h"
 
 static const char ElfMagic[] = { 0x7f, 'E', 'L', 'F', '\0' };
 
-Elf::Elf(std::vector<char> buf_):
-	buf(std::move(buf_)) 
-{
-	Initialize();
-}
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const int HostData = ELFDATA2MSB;
+#else
+static const int HostData = ELFDATA2LSB;
+#endif
 
-Elf::Elf(const std::string &path) {
-	std::ifstream input(path.c_str(), std::ios::in | std::ios::binary);
-	if (!input)
-		throw std::runtime_error("Cannot open input file for reading.");
+static uint16_t byte_swap(uint16_t value) { return __builtin_bswap16(value); }
+static uint32_t byte_swap(uint32_t value) { return __builtin_bswap32(value); }
+static uint64_t byte_swap(uint64_t value) { return __builtin_bswap64(value); }
 
-	std::streamsize size = stream_size(&input);
-	buf.resize(size);
-	if (!input.read(buf.data(), size))
-		throw std::runtime_error("Cannot read file into memory.");
+ElfFile::ElfFile(std::unique_ptr<MappedFile> file_, char *data_, size_t size_, bool writable_):
+	file(std::move(file_)),
+	data(data_),
+	size(size_),
+	writable(writable_)
+{}
 
-	Initialize();
+template <int Class, int Data>
+template <typename T>
+T Elf<Class, Data>::Get(const T &field) {
+	// the image may sit at any address, memcpy is still a single load
+	T value;
+	memcpy(&value, &field, sizeof(value));
+	if constexpr (Data != HostData)
+		value = byte_swap(value);
+	return value;
 }
 
-void Elf::Initialize() {
-	header = reinterpret_cast<Elf32_Ehdr*>(&buf[0]);
-	if (buf.size() < sizeof(*header))
-		throw std::runtime_error("Cannot read ELF header");
+template <int Class, int Data>
+template <typename T>
+void Elf<Class, Data>::Put(T *field, T value) {
+	if constexpr (Data != HostData)
+		value = byte_swap(value);
+	memcpy(field, &value, sizeof(value));
+}
 
-	if (memcmp(header->e_ident, ElfMagic, std::strlen(ElfMagic)) != 0)
-		throw std::runtime_error("Not an ELF file");
+template <int Class, int Data>
+Elf<Class, Data>::Elf(std::unique_ptr<MappedFile> file_, char *data_, size_t size_,
+		bool writable_):
+	ElfFile(std::move(file_), data_, size_, writable_)
+{
+	if (size < sizeof(typename Types::Ehdr))
+		throw std::runtime_error("Cannot read ELF header");
+	header = reinterpret_cast<typename Types::Ehdr*>(data);
 
-	if (buf.size() < header->e_phoff + sizeof(Elf32_Phdr) * header->e_phnum)
+	uint64_t phoff = Get(header->e_phoff);
+	if (!Contains(phoff, sizeof(typename Types::Phdr) * uint64_t(Get(header->e_phnum))))
 		throw std::runtime_error("Cannot read program headers");
-	pheader = reinterpret_cast<Elf32_Phdr*>(&buf[header->e_phoff]);
+	pheader = reinterpret_cast<typename Types::Phdr*>(&data[phoff]);
 
-	if (buf.size() < header->e_shoff + sizeof(Elf32_Shdr) * header->e_shnum)
+	uint64_t shoff = Get(header->e_shoff);
+	section_count = Get(header->e_shnum);
+	if (!Contains(shoff, sizeof(typename Types::Shdr) * uint64_t(section_count)))
 		throw std::runtime_error("Cannot read sections table");
 
-	sections = reinterpret_cast<Elf32_Shdr*>(&buf[header->e_shoff]);
+	sections = reinterpret_cast<typename Types::Shdr*>(&data[shoff]);
 
-	if (header->e_shstrndx >= header->e_shnum)
+	if (Get(header->e_shstrndx) >= section_count)
 		throw std::runtime_error("Invalid index of section header table");
 
-	shstr = &sections[header->e_shstrndx];
-	if (buf.size() < shstr->sh_offset + shstr->sh_size)
+	shstr = &sections[Get(header->e_shstrndx)];
+	if (!Contains(Get(shstr->sh_offset), Get(shstr->sh_size)))
 		throw std::runtime_error("Cannot read .shstrtab");
 
-	shstrtab = &buf[shstr->sh_offset];
+	shstrtab = &data[Get(shstr->sh_offset)];
 }
 
-void Elf::GetUndefinedSymbols(std::set<std::string> *output) {
-	const Elf32_Shdr *symtab_hdr = nullptr;
-	for (int i = 1; i < header->e_shnum; ++i) {
-		if (sections[i].sh_type == SHT_SYMTAB) {
+// Symbols per task when a large .symtab is scanned on several threads
+static const size_t SymbolRangeSize = 32 * 1024;
+
+template <int Class, int Data>
+void Elf<Class, Data>::GetSymbols(SymbolTables *output, unsigned jobs, bool referenced_only) {
+	typedef typename Types::Sym Sym;
+	typedef typename Types::Shdr Shdr;
+
+	const Shdr *symtab_hdr = nullptr;
+	for (size_t i = 1; i < section_count; ++i) {
+		if (Get(sections[i].sh_type) == SHT_SYMTAB) {
 			symtab_hdr = &sections[i];
 			break;
 		}
@@ -71,49 +100,173 @@ void Elf::GetUndefinedSymbols(std::set<std::string> *output) {
 	if (!symtab_hdr)
 		throw std::runtime_error("Cannot find .symtab section");
 
-	if (symtab_hdr->sh_offset + symtab_hdr->sh_size >= buf.size())
+	if (!Contains(Get(symtab_hdr->sh_offset), Get(symtab_hdr->sh_size)))
 		throw std::runtime_error("Cannot read .symtab section");
 
-	if (symtab_hdr->sh_link >= header->e_shnum)
+	if (Get(symtab_hdr->sh_link) >= section_count)
 		throw std::runtime_error("Cannot find STRTAB for .symtab section");
 
-	const Elf32_Shdr *strtab_hdr = &sections[symtab_hdr->sh_link];
-	if (strtab_hdr->sh_offset + strtab_hdr->sh_size >= buf.size())
+	const Shdr *strtab_hdr = &sections[Get(symtab_hdr->sh_link)];
+	if (!Contains(Get(strtab_hdr->sh_offset), Get(strtab_hdr->sh_size)))
 		throw std::runtime_error("Cannot read STRTAB section for .symtab");
 
-	const char *strtab = &buf[strtab_hdr->sh_offset];
-	const Elf32_Sym *symtab = reinterpret_cast<const Elf32_Sym*>(&buf[symtab_hdr->sh_offset]);
-	for (int i = 1; i < symtab_hdr->sh_size / symtab_hdr->sh_entsize; ++i) {
-		const Elf32_Sym &symbol = symtab[i];
-		if (symbol.st_name >= strtab_hdr->sh_size)
-			continue; // is it even a good idea to continue processing such broken elf?
+	if (Get(symtab_hdr->sh_entsize) != sizeof(Sym))
+		throw std::runtime_error("Unexpected .symtab entry size");
+
+	// locals come first and sh_info is the index of the first global, an
+	// undefined symbol can only be global (or the null symbol at index 0)
+	size_t count = Get(symtab_hdr->sh_size) / sizeof(Sym);
+	size_t first = Get(symtab_hdr->sh_info);
+	if (first < 1 || first > count)
+		first = std::min<size_t>(1, count);
+
+	std::vector<unsigned char> referenced;
+	if (referenced_only)
+		referenced = ReferencedSymbols(symtab_hdr - sections, count);
+	bool import_tables = HasImportTables();
+
+	const char *strtab = &data[Get(strtab_hdr->sh_offset)];
+	size_t strtab_size = Get(strtab_hdr->sh_size);
+	const Sym *symtab = reinterpret_cast<const Sym*>(&data[Get(symtab_hdr->sh_offset)]);
+
+	// Every range is filtered, named and hashed on its own, then the results
+	// are inserted range by range so the sets come out the same as with one
+	// thread. Small tables are a single range.
+	struct Found {
+		std::vector<SymbolSet::Entry> undefined, defined, weak;
+	};
+	size_t ranges = (count - first + SymbolRangeSize - 1) / SymbolRangeSize;
+	std::vector<Found> found(ranges);
+	parallel_for(ranges, jobs, [&](size_t range, unsigned) {
+		size_t begin = first + range * SymbolRangeSize;
+		size_t end = std::min(count, begin + SymbolRangeSize);
+		std::vector<uint32_t> undefined, defined;
+		// the vectorized filter reads ELF32 symbols in the host byte order
+		if constexpr (Class == ELFCLASS32 && Data == HostData) {
+			find_global_symbols(symtab, begin, end, &undefined, &defined);
+		} else {
+			for (size_t i = begin; i < end; ++i) {
+				if (Get(symtab[i].st_shndx) != SHN_UNDEF)
+					defined.push_back(i);
+				else if (symtab[i].getType() == STT_NOTYPE)
+					undefined.push_back(i);
+			}
+		}
+
+		auto entry = [&](const Sym &symbol, SymbolSet::Entry *output) {
+			uint32_t name_offset = Get(symbol.st_name);
+			if (name_offset >= strtab_size)
+				return false; // is it even a good idea to continue processing such broken elf?
+			const char *name = strtab + name_offset;
+			output->name = std::string_view(name, strnlen(name, strtab_size - name_offset));
+			output->hash = SymbolSet::Hash(output->name);
+			return !output->name.empty();
+		};
+
+		SymbolSet::Entry named;
+		for (auto i : undefined)
+			if ((!referenced_only || referenced[i]) && entry(symtab[i], &named))
+				found[range].undefined.push_back(named);
+		if (!import_tables)
+			for (auto i : defined) {
+				const Sym &symbol = symtab[i];
+				unsigned char binding = symbol.getBinding(), type = symbol.getType();
+				if ((binding != STB_GLOBAL && binding != STB_WEAK) || type == STT_SECTION || type == STT_FILE)
+					continue;
+				if (entry(symbol, &named))
+					(binding == STB_WEAK ? found[range].weak : found[range].defined).push_back(named);
+			}
+	});
+	for (auto &range : found) {
+		for (auto &entry : range.undefined)
+			output->undefined.Insert(entry);
+		for (auto &entry : range.defined)
+			output->defined.Insert(entry);
+		for (auto &entry : range.weak)
+			output->weak.Insert(entry);
+	}
+}
+
+// True for objects that import functions through the tables vitalink
+// generates, such as a __stubs.o from an earlier run
+template <int Class, int Data>
+bool Elf<Class, Data>::HasImportTables() const {
+	uint64_t names_size = Get(shstr->sh_size);
+	for (size_t i = 1; i < section_count; ++i) {
+		uint32_t name = Get(sections[i].sh_name);
+		if (name >= names_size)
+			continue;
+		size_t length = strnlen(shstrtab + name, names_size - name);
+		std::string_view section(shstrtab + name, length);
+		if (section == ".sceLib.stub" || section == ".sceFNID.rodata")
+			return true;
+	}
+	return false;
+}
+
+// Flags every symbol of the table at `symtab_index` that a relocation in
+// an allocated section refers to. Relocations for debug info and other
+// sections that never reach the final image do not count.
+template <int Class, int Data>
+std::vector<unsigned char> Elf<Class, Data>::ReferencedSymbols(size_t symtab_index, size_t count) const {
+	typedef typename Types::Rel Rel;
+	typedef typename Types::Rela Rela;
+
+	std::vector<unsigned char> referenced(count, 0);
+	for (size_t i = 1; i < section_count; ++i) {
+		const auto &rel = sections[i];
+		uint32_t type = Get(rel.sh_type);
+		if ((type != SHT_REL && type != SHT_RELA) || Get(rel.sh_link) != symtab_index)
+			continue;
+		uint32_t target = Get(rel.sh_info);
+		if (target >= section_count || !(Get(sections[target].sh_flags) & SHF_ALLOC))
+			continue;
 
-		if (symbol.getType() == STT_NOTYPE && symbol.st_shndx == STN_UNDEF)
-			output->insert(strtab + symbol.st_name);
+		size_t entsize = type == SHT_REL ? sizeof(Rel) : sizeof(Rela);
+		if (Get(rel.sh_entsize) != entsize)
+			throw std::runtime_error("Unexpected relocation entry size");
+		uint64_t rel_size = Get(rel.sh_size);
+		if (!Contains(Get(rel.sh_offset), rel_size))
+			throw std::runtime_error("Cannot read relocation section");
+
+		// r_info sits at the same offset in both layouts
+		const char *entries = data + Get(rel.sh_offset);
+		for (uint64_t offset = 0; offset + entsize <= rel_size; offset += entsize) {
+			const Rel &relocation = *reinterpret_cast<const Rel*>(entries + offset);
+			uint64_t symbol = Get(relocation.r_info) >> Types::SymbolShift;
+			if (symbol < count)
+				referenced[symbol] = 1;
+		}
 	}
+	return referenced;
 }
 
-void Elf::FixupTopEnd() {
+template <int Class, int Data>
+void Elf<Class, Data>::FixupTopEnd() {
+	if (!writable)
+		throw std::runtime_error("Cannot fixup elf opened read-only");
+
 	uint32_t ent_top, ent_end, stub_top, stub_end;
 	ent_top = ent_end = stub_top = stub_end = 0;
 
-	if (header->e_phoff < 1)
+	if (Get(header->e_phoff) < 1)
 		throw std::runtime_error("No segments defined");
 
-	uint32_t base_vaddr = pheader[0].p_vaddr;
-	int module_info_idx = 0;
+	uint32_t base_vaddr = Get(pheader[0].p_vaddr);
+	size_t module_info_idx = 0;
 
-	for (int i = 1; i < header->e_shnum; ++i) {
+	for (size_t i = 1; i < section_count; ++i) {
 		auto &section = sections[i];
-		if (section.sh_name >= shstr->sh_size)
+		if (Get(section.sh_name) >= Get(shstr->sh_size))
 			throw std::runtime_error("Cannot read name for section " + std::to_string(i));
-		char *name = &shstrtab[section.sh_name];
+		char *name = &shstrtab[Get(section.sh_name)];
+		uint32_t addr = Get(section.sh_addr), end = addr + Get(section.sh_size);
 		if (name == std::string(".sceLib.ent")) {
-			ent_top = section.sh_addr - base_vaddr;
-			ent_end = section.sh_addr + section.sh_size - base_vaddr;
+			ent_top = addr - base_vaddr;
+			ent_end = end - base_vaddr;
 		} else if (name == std::string(".sceLib.stub")) {
-			stub_top = section.sh_addr - base_vaddr;
-			stub_end = section.sh_addr + section.sh_size - base_vaddr;
+			stub_top = addr - base_vaddr;
+			stub_end = end - base_vaddr;
 		} else if (name == std::string(".sceModuleInfo.rodata")) {
 			module_info_idx = i;
 		}
@@ -122,17 +275,56 @@ void Elf::FixupTopEnd() {
 		throw std::runtime_error("Cannot fixup elf because some sections are missing");
 
 	auto &module_info_hdr = sections[module_info_idx];
-	if (module_info_hdr.sh_offset + module_info_hdr.sh_size >= buf.size())
+	uint64_t module_info_offset = Get(module_info_hdr.sh_offset);
+	if (!Contains(module_info_offset, Get(module_info_hdr.sh_size)) || size - module_info_offset < sizeof(module_info))
 		throw std::runtime_error("Cannot locate .sceModuleInfo.rodata");
 
-	module_info *mi = reinterpret_cast<module_info*>(&buf[module_info_hdr.sh_offset]);
-	mi->ent_top = ent_top;
-	mi->ent_end = ent_end;
-	mi->stub_top = stub_top;
-	mi->stub_end = stub_end;
+	module_info *mi = reinterpret_cast<module_info*>(&data[module_info_offset]);
+	Put(&mi->ent_top, ent_top);
+	Put(&mi->ent_end, ent_end);
+	Put(&mi->stub_top, stub_top);
+	Put(&mi->stub_end, stub_end);
+}
+
+template class Elf<ELFCLASS32, ELFDATA2LSB>;
+template class Elf<ELFCLASS32, ELFDATA2MSB>;
+template class Elf<ELFCLASS64, ELFDATA2LSB>;
+template class Elf<ELFCLASS64, ELFDATA2MSB>;
+
+static std::unique_ptr<ElfFile> make_elf(std::unique_ptr<MappedFile> file, char *data,
+		size_t size, bool writable) {
+	if (size < EI_NIDENT || memcmp(data, ElfMagic, std::strlen(ElfMagic)) != 0)
+		throw std::runtime_error("Not an ELF file");
+
+	int elf_class = data[EI_CLASS], elf_data = data[EI_DATA];
+	if (elf_data != ELFDATA2LSB && elf_data != ELFDATA2MSB)
+		throw std::runtime_error("Unsupported ELF byte order");
+
+	typedef std::unique_ptr<ElfFile> Result;
+	if (elf_class == ELFCLASS32 && elf_data == ELFDATA2LSB)
+		return Result(new Elf<ELFCLASS32, ELFDATA2LSB>(std::move(file), data, size, writable));
+	if (elf_class == ELFCLASS32)
+		return Result(new Elf<ELFCLASS32, ELFDATA2MSB>(std::move(file), data, size, writable));
+	if (elf_class == ELFCLASS64 && elf_data == ELFDATA2LSB)
+		return Result(new Elf<ELFCLASS64, ELFDATA2LSB>(std::move(file), data, size, writable));
+	if (elf_class == ELFCLASS64)
+		return Result(new Elf<ELFCLASS64, ELFDATA2MSB>(std::move(file), data, size, writable));
+	throw std::runtime_error("Unsupported ELF class");
+}
+
+std::unique_ptr<ElfFile> open_elf(const std::string &path, MappedFile::Mode mode) {
+	std::unique_ptr<MappedFile> file(new MappedFile(path, mode));
+	char *data = file->Data();
+	size_t size = file->Size();
+	bool writable = file->Writable();
+	return make_elf(std::move(file), data, size, writable);
+}
+
+std::unique_ptr<ElfFile> open_elf(const char *data, size_t size) {
+	return make_elf(nullptr, const_cast<char*>(data), size, false);
 }
 
-void Elf::Write(const std::string &path) {
-	std::ofstream output(path.c_str(), std::ios::out | std::ios::binary);
-	output.write(buf.data(), buf.size());
+void ElfFile::Flush() {
+	if (file)
+		file->Sync();
 }
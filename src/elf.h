@@ -1,24 +1,94 @@
 #pragma once
 
-#include <set>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "elftypes.h"
+#include "mappedfile.h"
+#include "symbolset.h"
 
-class Elf {
+/**
+ * \brief ELF image of any class and byte order
+ *
+ * Created with open_elf(), which picks the Elf<Class, Data> that matches
+ * the file's identification bytes.
+ */
+class ElfFile {
 public:
-	explicit Elf(std::vector<char> buf_);
-	explicit Elf(const std::string &path);
-	void GetUndefinedSymbols(std::set<std::string> *output);
-	void FixupTopEnd();
-	void Write(const std::string &path);
+	virtual ~ElfFile() {}
+	// Adds the global symbols the object references and defines. The names
+	// are not copied and point into the ELF image. Large symbol tables are
+	// split into ranges scanned on up to `jobs` threads. With
+	// `referenced_only`, undefined symbols no relocation of an allocated
+	// section refers to are left out. Objects with import tables
+	// (.sceLib.stub, .sceFNID.rodata) define nothing as far as this is
+	// concerned, their functions are only stubs for the real ones.
+	virtual void GetSymbols(SymbolTables *output, unsigned jobs = 1, bool referenced_only = false) = 0;
+	virtual void FixupTopEnd() = 0;
+	void Flush();
+protected:
+	ElfFile(std::unique_ptr<MappedFile> file_, char *data_, size_t size_, bool writable_);
+	// True if [offset, offset + length) lies within the image
+	bool Contains(uint64_t offset, uint64_t length) const {
+		return offset <= size && length <= size - offset;
+	}
+	std::unique_ptr<MappedFile> file;
+	char *data;
+	size_t size;
+	bool writable;
+};
+
+std::unique_ptr<ElfFile> open_elf(const std::string &path, MappedFile::Mode mode = MappedFile::Mode::ReadOnly);
+// read-only view over memory owned by the caller, e.g. an archive member
+std::unique_ptr<ElfFile> open_elf(const char *data, size_t size);
+
+// Structures of an ELF class and where the symbol index sits in r_info
+template <int Class> struct ElfTypes;
+
+template <> struct ElfTypes<ELFCLASS32> {
+	typedef Elf32_Ehdr Ehdr;
+	typedef Elf32_Phdr Phdr;
+	typedef Elf32_Shdr Shdr;
+	typedef Elf32_Sym Sym;
+	typedef Elf32_Rel Rel;
+	typedef Elf32_Rela Rela;
+	static const unsigned SymbolShift = 8;
+};
+
+template <> struct ElfTypes<ELFCLASS64> {
+	typedef Elf64_Ehdr Ehdr;
+	typedef Elf64_Phdr Phdr;
+	typedef Elf64_Shdr Shdr;
+	typedef Elf64_Sym Sym;
+	typedef Elf64_Rel Rel;
+	typedef Elf64_Rela Rela;
+	static const unsigned SymbolShift = 32;
+};
+
+/**
+ * \brief ELF image of class `Class` (ELFCLASS*) in byte order `Data` (ELFDATA*)
+ *
+ * Every field goes through Get() and Put(). Whether they swap bytes is
+ * decided at compile time, so an image in the host byte order is read with
+ * plain loads and a foreign one with bswap.
+ */
+template <int Class, int Data>
+class Elf : public ElfFile {
+public:
+	typedef ElfTypes<Class> Types;
+	Elf(std::unique_ptr<MappedFile> file_, char *data_, size_t size_, bool writable_);
+	void GetSymbols(SymbolTables *output, unsigned jobs = 1, bool referenced_only = false) override;
+	void FixupTopEnd() override;
 private:
-	void Initialize();
-	std::vector<char> buf;
-	Elf32_Ehdr *header;
-	Elf32_Phdr *pheader;
-	Elf32_Shdr *sections;
-	Elf32_Shdr *shstr;
+	template <typename T> static T Get(const T &field);
+	template <typename T> static void Put(T *field, T value);
+	bool HasImportTables() const;
+	std::vector<unsigned char> ReferencedSymbols(size_t symtab_index, size_t count) const;
+	typename Types::Ehdr *header;
+	typename Types::Phdr *pheader;
+	typename Types::Shdr *sections;
+	typename Types::Shdr *shstr;
 	char *shstrtab;
+	size_t section_count;
 };
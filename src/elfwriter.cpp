@@ -0,0 +1,161 @@
+#include "elfwriter.h"
+
+#include <stdexcept>
+
+#include "utility.h"
+
+static const uint32_t EhdrSize = 52;
+static const uint32_t ShdrSize = 40;
+static const uint32_t SymSize = 16;
+static const uint32_t RelSize = 8;
+
+ElfWriter::ElfWriter(Elf32_Half machine_, Elf32_Word flags_):
+	machine(machine_),
+	flags(flags_)
+{}
+
+Elf32_Half ElfWriter::AddSection(const std::string &name, Elf32_Word type, Elf32_Word flags, Elf32_Word align) {
+	sections.push_back(Section{name, type, flags, align, std::string(), {}});
+	return sections.size();
+}
+
+size_t ElfWriter::AddSymbol(const std::string &name, Elf32_Half section, Elf32_Addr value, unsigned char binding, unsigned char type) {
+	symbols.push_back(Symbol{name, section, value, binding, type});
+	return symbols.size() - 1;
+}
+
+void ElfWriter::AddRelocation(Elf32_Half section, Elf32_Addr offset, size_t symbol, unsigned char type) {
+	sections[section - 1].relocations.push_back(std::make_pair(offset, std::make_pair(symbol, type)));
+}
+
+static void add_string(std::string *table, const std::string &name, Elf32_Word *offset) {
+	*offset = table->size();
+	*table += name;
+	table->push_back('\0');
+}
+
+static void align_to(std::string *image, uint32_t align) {
+	if (align > 1)
+		image->resize((image->size() + align - 1) / align * align, '\0');
+}
+
+std::string ElfWriter::Build() const {
+	// The symbol table must list every local before the first global
+	std::vector<Elf32_Word> symbol_index(symbols.size());
+	std::vector<size_t> order;
+	for (int pass = 0; pass < 2; ++pass)
+		for (size_t i = 0; i < symbols.size(); ++i)
+			if ((symbols[i].binding == STB_LOCAL) == (pass == 0)) {
+				symbol_index[i] = order.size() + 1;
+				order.push_back(i);
+			}
+	Elf32_Word first_global = 1;
+	for (auto i : order)
+		if (symbols[i].binding == STB_LOCAL)
+			++first_global;
+
+	std::string strtab(1, '\0'), symtab(SymSize, '\0');
+	for (auto i : order) {
+		auto &symbol = symbols[i];
+		Elf32_Word name;
+		add_string(&strtab, symbol.name, &name);
+		write_le32(&symtab, name);
+		write_le32(&symtab, symbol.value);
+		write_le32(&symtab, 0);
+		symtab.push_back(static_cast<char>((symbol.binding << 4) | (symbol.type & 0x0f)));
+		symtab.push_back(0);
+		write_le16(&symtab, symbol.section);
+	}
+
+	struct Header {
+		Elf32_Word name, type, flags, offset, size, link, info, align, entsize;
+	};
+	std::vector<Header> headers(1, Header());
+	std::string shstrtab(1, '\0');
+	std::string image(EhdrSize, '\0');
+
+	auto place = [&](const std::string &name, Elf32_Word type, Elf32_Word flags, Elf32_Word align, const std::string &data) -> Elf32_Word {
+		Header header = Header();
+		add_string(&shstrtab, name, &header.name);
+		header.type = type;
+		header.flags = flags;
+		header.align = align;
+		align_to(&image, align);
+		header.offset = image.size();
+		header.size = data.size();
+		if (type != SHT_NOBITS)
+			image += data;
+		headers.push_back(header);
+		return headers.size() - 1;
+	};
+
+	for (auto &section : sections)
+		place(section.name, section.type, section.flags, section.align, section.data);
+
+	Elf32_Word symtab_index = headers.size();
+	for (auto &section : sections)
+		if (!section.relocations.empty())
+			++symtab_index;
+
+	for (size_t i = 0; i < sections.size(); ++i) {
+		auto &section = sections[i];
+		if (section.relocations.empty())
+			continue;
+		std::string rel;
+		for (auto &relocation : section.relocations) {
+			write_le32(&rel, relocation.first);
+			write_le32(&rel, (symbol_index.at(relocation.second.first) << 8) | relocation.second.second);
+		}
+		auto index = place(".rel" + section.name, SHT_REL, SHF_INFO_LINK, 4, rel);
+		headers[index].link = symtab_index;
+		headers[index].info = i + 1;
+		headers[index].entsize = RelSize;
+	}
+
+	auto index = place(".symtab", SHT_SYMTAB, 0, 4, symtab);
+	if (index != symtab_index)
+		throw std::logic_error("Misplaced .symtab");
+	headers[index].link = index + 1;
+	headers[index].info = first_global;
+	headers[index].entsize = SymSize;
+	place(".strtab", SHT_STRTAB, 0, 1, strtab);
+	// place() records the name before copying the data, so .shstrtab contains its own name
+	Elf32_Word shstrndx = place(".shstrtab", SHT_STRTAB, 0, 1, shstrtab);
+
+	align_to(&image, 4);
+	Elf32_Off shoff = image.size();
+	for (auto &header : headers) {
+		write_le32(&image, header.name);
+		write_le32(&image, header.type);
+		write_le32(&image, header.flags);
+		write_le32(&image, 0);
+		write_le32(&image, header.offset);
+		write_le32(&image, header.size);
+		write_le32(&image, header.link);
+		write_le32(&image, header.info);
+		write_le32(&image, header.align);
+		write_le32(&image, header.entsize);
+	}
+
+	std::string ehdr;
+	ehdr += "\x7f" "ELF";
+	ehdr.push_back(ELFCLASS32);
+	ehdr.push_back(ELFDATA2LSB);
+	ehdr.push_back(EV_CURRENT);
+	ehdr.resize(EI_NIDENT, '\0');
+	write_le16(&ehdr, ET_REL);
+	write_le16(&ehdr, machine);
+	write_le32(&ehdr, EV_CURRENT);
+	write_le32(&ehdr, 0); // e_entry
+	write_le32(&ehdr, 0); // e_phoff
+	write_le32(&ehdr, shoff);
+	write_le32(&ehdr, flags);
+	write_le16(&ehdr, EhdrSize);
+	write_le16(&ehdr, 0); // e_phentsize
+	write_le16(&ehdr, 0); // e_phnum
+	write_le16(&ehdr, ShdrSize);
+	write_le16(&ehdr, headers.size());
+	write_le16(&ehdr, shstrndx);
+	image.replace(0, EhdrSize, ehdr);
+	return image;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "elftypes.h"
+
+/**
+ * \brief Builder for little-endian ELF32 relocatable objects
+ *
+ * Sections are numbered from 1 in the order they are added; relocation
+ * sections, .symtab, .strtab and .shstrtab are appended by Build().
+ * Relocations are SHT_REL, so addends live in the section data.
+ */
+class ElfWriter {
+public:
+	ElfWriter(Elf32_Half machine_, Elf32_Word flags_);
+	// Returns the index of the new section
+	Elf32_Half AddSection(const std::string &name, Elf32_Word type, Elf32_Word flags, Elf32_Word align);
+	std::string &Data(Elf32_Half section) { return sections[section - 1].data; }
+	// Returns a handle for AddRelocation; `section` is SHN_UNDEF for an external symbol
+	size_t AddSymbol(const std::string &name, Elf32_Half section, Elf32_Addr value, unsigned char binding, unsigned char type);
+	void AddRelocation(Elf32_Half section, Elf32_Addr offset, size_t symbol, unsigned char type);
+	std::string Build() const;
+private:
+	struct Section {
+		std::string name;
+		Elf32_Word type;
+		Elf32_Word flags;
+		Elf32_Word align;
+		std::string data;
+		std::vector<std::pair<Elf32_Addr, std::pair<size_t, unsigned char>>> relocations;
+	};
+
+	struct Symbol {
+		std::string name;
+		Elf32_Half section;
+		Elf32_Addr value;
+		unsigned char binding;
+		unsigned char type;
+	};
+
+	Elf32_Half machine;
+	Elf32_Word flags;
+	std::vector<Section> sections;
+	std::vector<Symbol> symbols;
+};
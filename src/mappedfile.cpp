@@ -0,0 +1,49 @@
+#include "mappedfile.h"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path, Mode mode_):
+	addr(nullptr),
+	length(0),
+	mode(mode_)
+{
+	int fd = open(path.c_str(), mode == Mode::ReadWrite ? O_RDWR : O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error(mode == Mode::ReadWrite ? "Cannot open file for writing." : "Cannot open input file for reading.");
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Cannot stat input file.");
+	}
+	length = st.st_size;
+
+	// mmap refuses zero-length mappings; leave an empty file unmapped
+	if (length) {
+		int prot = mode == Mode::ReadWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+		void *p = mmap(nullptr, length, prot, mode == Mode::ReadWrite ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Cannot map file into memory.");
+		}
+		addr = static_cast<char*>(p);
+		// we jump between a few tables, readahead would only pull in .text/.debug_*
+		madvise(p, length, MADV_RANDOM);
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile() {
+	if (addr)
+		munmap(addr, length);
+}
+
+void MappedFile::Sync() {
+	if (addr && mode == Mode::ReadWrite && msync(addr, length, MS_SYNC) != 0)
+		throw std::runtime_error("Cannot write changes back to file.");
+}
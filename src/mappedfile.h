@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * \brief Read-only or shared-writable mapping of a whole file
+ *
+ * Pages are only faulted in when touched, so callers that look at a
+ * handful of tables in a large file never read the rest of it.
+ */
+class MappedFile {
+public:
+	enum class Mode {
+		ReadOnly,
+		ReadWrite, // MAP_SHARED: stores go straight back to the file
+	};
+
+	explicit MappedFile(const std::string &path, Mode mode = Mode::ReadOnly);
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	char *Data() const { return addr; }
+	size_t Size() const { return length; }
+	bool Writable() const { return mode == Mode::ReadWrite; }
+	void Sync();
+private:
+	char *addr;
+	size_t length;
+	Mode mode;
+};
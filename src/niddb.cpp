@@ -0,0 +1,450 @@
+#include "niddb.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include "nidtext.h"
+#include "nidxml.h"
+#include "utility.h"
+
+namespace {
+
+class ModuleCollector : public NidXmlVisitor {
+public:
+	explicit ModuleCollector(std::vector<NidModule> *modules_):
+		modules(modules_)
+	{}
+
+	void Module(const char *name, size_t length, uint32_t nid) override {
+		modules->push_back(NidModule{std::string(name, length), nid, {}});
+	}
+
+	void Function(const char *name, size_t length, uint32_t nid) override {
+		modules->back().functions.push_back(NidFunction{std::string(name, length), nid});
+	}
+private:
+	std::vector<NidModule> *modules;
+};
+
+}
+
+// Databases smaller than this are not worth splitting
+static const size_t ParallelXmlThreshold = 1 << 20;
+
+// Finds the first "<library" tag at or after `offset`
+static size_t find_library(const char *text, size_t size, size_t offset) {
+	static const char tag[] = "<library";
+	static const size_t tag_size = sizeof(tag) - 1;
+	while (offset < size) {
+		const char *p = static_cast<const char*>(memchr(text + offset, '<', size - offset));
+		if (!p)
+			break;
+		offset = p - text;
+		if (size - offset > tag_size && memcmp(p, tag, tag_size) == 0) {
+			char next = p[tag_size];
+			if (next == ' ' || next == '\t' || next == '\n' || next == '\r' || next == '>' || next == '/')
+				return offset;
+		}
+		++offset;
+	}
+	return size;
+}
+
+static std::vector<NidModule> parse_chunk(const char *text, size_t size) {
+	std::vector<NidModule> modules;
+	ModuleCollector collector(&modules);
+	parse_nids_xml(text, size, &collector);
+	return modules;
+}
+
+std::vector<NidModule> read_nids_xml(const std::string &path, unsigned jobs) {
+	MappedFile file(path);
+	const char *text = file.Data();
+	size_t size = file.Size();
+	if (jobs <= 1 || size < ParallelXmlThreshold)
+		return parse_chunk(text, size);
+
+	// Top-level <library> elements are independent: cut the file at the first
+	// "<library" after evenly spaced offsets and parse the pieces in parallel.
+	// A cut that lands inside a comment or CDATA leaves the piece before it
+	// unterminated, in which case the whole file is parsed again serially.
+	size_t pieces = jobs * 4;
+	std::vector<size_t> cuts(1, 0);
+	for (size_t i = 1; i < pieces; ++i) {
+		size_t cut = find_library(text, size, std::max(cuts.back() + 1, size / pieces * i));
+		if (cut >= size)
+			break;
+		cuts.push_back(cut);
+	}
+	cuts.push_back(size);
+
+	std::vector<std::vector<NidModule>> results(cuts.size() - 1);
+	try {
+		parallel_for(results.size(), jobs, [&](size_t i, unsigned) {
+			results[i] = parse_chunk(text + cuts[i], cuts[i + 1] - cuts[i]);
+		});
+	} catch (const std::runtime_error &) {
+		return parse_chunk(text, size);
+	}
+
+	std::vector<NidModule> modules;
+	for (auto &result : results)
+		std::move(result.begin(), result.end(), std::back_inserter(modules));
+	return modules;
+}
+
+std::vector<NidModule> read_nids_text(const std::string &path) {
+	MappedFile file(path);
+	std::vector<NidModule> modules;
+	parse_nids_text(file.Data(), file.Size(), &modules);
+	return modules;
+}
+
+NidFormat detect_nid_format(const std::string &path) {
+	MappedFile file(path);
+	if (CompiledNidDb::IsCompiled(file.Data(), file.Size()))
+		return NidFormat::Compiled;
+	return is_nids_xml(file.Data(), file.Size()) ? NidFormat::Xml : NidFormat::Text;
+}
+
+std::vector<NidModule> read_nid_modules(const std::string &path, unsigned jobs) {
+	switch (detect_nid_format(path)) {
+	case NidFormat::Compiled:
+		return CompiledNidDb(path).Modules();
+	case NidFormat::Xml:
+		return read_nids_xml(path, jobs);
+	case NidFormat::Text:
+		break;
+	}
+	return read_nids_text(path);
+}
+
+// Cuts the file before every "<library", so that each piece holds one library
+// (the first one holds whatever precedes them) and editing a library only
+// changes its own piece.
+static std::vector<size_t> library_cuts(const char *text, size_t size) {
+	std::vector<size_t> cuts(1, 0);
+	for (size_t cut = find_library(text, size, 0); cut < size; cut = find_library(text, size, cut + 1))
+		if (cut)
+			cuts.push_back(cut);
+	cuts.push_back(size);
+	return cuts;
+}
+
+size_t compile_nid_database(const std::string &xml_path, const std::string &output_path, unsigned jobs) {
+	MappedFile file(xml_path);
+	const char *text = file.Data();
+	size_t size = file.Size();
+	if (!is_nids_xml(text, size)) {
+		// Text databases have no libraries to reuse, and parse fast enough anyway
+		std::vector<NidModule> modules;
+		parse_nids_text(text, size, &modules);
+		CompiledNidDb::Write(modules, std::vector<NidLibrary>(), output_path);
+		return 0;
+	}
+
+	// Modules of the previous build, by the hash of the library text they came from
+	std::unordered_map<uint64_t, std::vector<NidModule>> previous;
+	try {
+		CompiledNidDb db(output_path);
+		auto modules = db.Modules();
+		size_t first = 0;
+		for (auto &library : db.Libraries()) {
+			if (first + library.module_count > modules.size())
+				throw std::runtime_error("Corrupted compiled NID database");
+			auto begin = modules.begin() + first;
+			previous.emplace(library.hash, std::vector<NidModule>(std::make_move_iterator(begin),
+				std::make_move_iterator(begin + library.module_count)));
+			first += library.module_count;
+		}
+	} catch (const std::runtime_error &) {
+		// missing, outdated or not a compiled database at all: start from scratch
+		previous.clear();
+	}
+
+	auto cuts = library_cuts(text, size);
+
+	std::vector<NidLibrary> libraries(cuts.size() - 1);
+	std::vector<std::vector<NidModule>> results(libraries.size());
+	std::vector<size_t> changed;
+	for (size_t i = 0; i < libraries.size(); ++i) {
+		libraries[i].hash = hash_text(text + cuts[i], cuts[i + 1] - cuts[i]);
+		auto found = previous.find(libraries[i].hash);
+		if (found != previous.end())
+			results[i] = found->second;
+		else
+			changed.push_back(i);
+	}
+
+	try {
+		parallel_for(changed.size(), jobs, [&](size_t i, unsigned) {
+			size_t library = changed[i];
+			results[library] = parse_chunk(text + cuts[library], cuts[library + 1] - cuts[library]);
+		});
+	} catch (const std::runtime_error &) {
+		// A "<library" inside a comment or CDATA: the pieces are not whole
+		// libraries, so compile the file in one go and record no libraries.
+		// Such a database is rebuilt in full every time.
+		CompiledNidDb::Write(parse_chunk(text, size), std::vector<NidLibrary>(), output_path);
+		return libraries.size();
+	}
+
+	std::vector<NidModule> modules;
+	for (size_t i = 0; i < results.size(); ++i) {
+		libraries[i].module_count = results[i].size();
+		std::move(results[i].begin(), results[i].end(), std::back_inserter(modules));
+	}
+	CompiledNidDb::Write(modules, libraries, output_path);
+	return changed.size();
+}
+
+void NidOverlay::Add(const std::string &name, std::unique_ptr<NidDatabase> db) {
+	layers.push_back(std::make_pair(name, std::move(db)));
+}
+
+bool NidOverlay::LayerLookup(size_t layer, const std::string &name, NidMatch *match) const {
+	try {
+		return layers[layer].second->Lookup(name, match);
+	} catch (const std::runtime_error &e) {
+		throw std::runtime_error(layers[layer].first + ": " + e.what());
+	}
+}
+
+bool NidOverlay::Lookup(const std::string &name, NidMatch *match) const {
+	size_t found = layers.size();
+	for (size_t i = layers.size(); i-- > 0; )
+		if (LayerLookup(i, name, match)) {
+			found = i;
+			break;
+		}
+	if (found == layers.size())
+		return false;
+
+	NidMatch shadowed;
+	for (size_t i = 0; i < found; ++i)
+		if (LayerLookup(i, name, &shadowed)
+				&& (shadowed.nid != match->nid || shadowed.module_nid != match->module_nid || shadowed.module_name != match->module_name))
+			std::cerr << "warning: " << name << ": " << layers[found].first << " (" << match->module_name << ", 0x"
+				<< std::hex << match->nid << ") overrides " << layers[i].first << " (" << shadowed.module_name
+				<< ", 0x" << shadowed.nid << std::dec << ")" << std::endl;
+	return true;
+}
+
+NidIndex::NidIndex(std::vector<NidModule> modules_):
+	modules(std::move(modules_))
+{
+	for (size_t i = 0; i < modules.size(); ++i)
+		for (size_t j = 0; j < modules[i].functions.size(); ++j)
+			index.emplace(modules[i].functions[j].name, std::make_pair(uint32_t(i), uint32_t(j)));
+}
+
+bool NidIndex::Lookup(const std::string &name, NidMatch *match) const {
+	auto entry = index.find(name);
+	if (entry == index.end())
+		return false;
+
+	auto &module = modules[entry->second.first];
+	match->module_name = module.name;
+	match->module_nid = module.nid;
+	match->nid = module.functions[entry->second.second].nid;
+	return true;
+}
+
+/*
+ * Compiled database layout, all fields are little-endian uint32:
+ *
+ *   header     magic "VNDB", version, module count, function count,
+ *              library count, offsets of the module table, function table,
+ *              library table and string pool, size of the string pool
+ *   modules    { nid, name offset, name length }, in database order
+ *   functions  { name hash, name offset, name length, module index, nid },
+ *              sorted by (hash, name, database order)
+ *   libraries  { text hash low, text hash high, module count }, in database
+ *              order; each library owns the next `module count` modules
+ *   strings    names, not NUL-terminated
+ */
+static const char NidDbMagic[] = { 'V', 'N', 'D', 'B' };
+static const uint32_t NidDbVersion = 2;
+static const uint32_t NidDbHeaderSize = 10 * 4;
+static const uint32_t NidDbModuleSize = 3 * 4;
+static const uint32_t NidDbFunctionSize = 5 * 4;
+static const uint32_t NidDbLibrarySize = 3 * 4;
+
+CompiledNidDb::CompiledNidDb(const std::string &path):
+	file(path),
+	data(file.Data())
+{
+	if (!IsCompiled(data, file.Size()))
+		throw std::runtime_error("Not a compiled NID database");
+	if (read_le32(data + 4) != NidDbVersion)
+		throw std::runtime_error("Unsupported compiled NID database version, recompile it with --compile-db");
+
+	uint64_t size = file.Size();
+	if (size < NidDbHeaderSize)
+		throw std::runtime_error("Truncated compiled NID database");
+	module_count = read_le32(data + 8);
+	function_count = read_le32(data + 12);
+	library_count = read_le32(data + 16);
+	modules_offset = read_le32(data + 20);
+	functions_offset = read_le32(data + 24);
+	libraries_offset = read_le32(data + 28);
+	strings_offset = read_le32(data + 32);
+	strings_size = read_le32(data + 36);
+
+	if (modules_offset + uint64_t(module_count) * NidDbModuleSize > size
+			|| functions_offset + uint64_t(function_count) * NidDbFunctionSize > size
+			|| libraries_offset + uint64_t(library_count) * NidDbLibrarySize > size
+			|| uint64_t(strings_offset) + strings_size > size)
+		throw std::runtime_error("Truncated compiled NID database");
+}
+
+std::unique_ptr<NidDatabase> open_nid_database(const std::string &path, unsigned jobs) {
+	switch (detect_nid_format(path)) {
+	case NidFormat::Compiled:
+		return std::unique_ptr<NidDatabase>(new CompiledNidDb(path));
+	case NidFormat::Xml:
+		return std::unique_ptr<NidDatabase>(new NidIndex(read_nids_xml(path, jobs)));
+	case NidFormat::Text:
+		break;
+	}
+	return std::unique_ptr<NidDatabase>(new NidIndex(read_nids_text(path)));
+}
+
+bool CompiledNidDb::IsCompiled(const char *data, size_t size) {
+	// magic and version are enough, older versions are rejected with a proper message
+	return size >= sizeof(NidDbMagic) + 4 && memcmp(data, NidDbMagic, sizeof(NidDbMagic)) == 0;
+}
+
+const char *CompiledNidDb::String(uint32_t offset, uint32_t length) const {
+	if (uint64_t(offset) + length > strings_size)
+		throw std::runtime_error("Corrupted compiled NID database");
+	return data + strings_offset + offset;
+}
+
+bool CompiledNidDb::Lookup(const std::string &name, NidMatch *match) const {
+	uint32_t hash = hash_name(name.data(), name.size());
+
+	// lower bound on the hash, then walk the (usually single) run of equal hashes
+	uint32_t first = 0, count = function_count;
+	while (count) {
+		uint32_t step = count / 2;
+		if (read_le32(data + functions_offset + (first + step) * NidDbFunctionSize) < hash) {
+			first += step + 1;
+			count -= step + 1;
+		} else {
+			count = step;
+		}
+	}
+
+	for (uint32_t i = first; i < function_count; ++i) {
+		const char *function = data + functions_offset + i * NidDbFunctionSize;
+		if (read_le32(function) != hash)
+			break;
+		uint32_t name_length = read_le32(function + 8);
+		if (name_length != name.size() || memcmp(String(read_le32(function + 4), name_length), name.data(), name_length) != 0)
+			continue;
+
+		uint32_t module_index = read_le32(function + 12);
+		if (module_index >= module_count)
+			throw std::runtime_error("Corrupted compiled NID database");
+		const char *module = data + modules_offset + module_index * NidDbModuleSize;
+		match->module_nid = read_le32(module);
+		match->module_name.assign(String(read_le32(module + 4), read_le32(module + 8)), read_le32(module + 8));
+		match->nid = read_le32(function + 16);
+		return true;
+	}
+	return false;
+}
+
+std::vector<NidLibrary> CompiledNidDb::Libraries() const {
+	std::vector<NidLibrary> libraries(library_count);
+	for (uint32_t i = 0; i < library_count; ++i) {
+		const char *library = data + libraries_offset + i * NidDbLibrarySize;
+		libraries[i].hash = read_le32(library) | (uint64_t(read_le32(library + 4)) << 32);
+		libraries[i].module_count = read_le32(library + 8);
+	}
+	return libraries;
+}
+
+std::vector<NidModule> CompiledNidDb::Modules() const {
+	std::vector<NidModule> modules(module_count);
+	for (uint32_t i = 0; i < module_count; ++i) {
+		const char *module = data + modules_offset + i * NidDbModuleSize;
+		modules[i].nid = read_le32(module);
+		modules[i].name.assign(String(read_le32(module + 4), read_le32(module + 8)), read_le32(module + 8));
+	}
+	for (uint32_t i = 0; i < function_count; ++i) {
+		const char *function = data + functions_offset + i * NidDbFunctionSize;
+		uint32_t module_index = read_le32(function + 12);
+		if (module_index >= module_count)
+			throw std::runtime_error("Corrupted compiled NID database");
+		uint32_t name_length = read_le32(function + 8);
+		modules[module_index].functions.push_back(NidFunction{
+			std::string(String(read_le32(function + 4), name_length), name_length), read_le32(function + 16)});
+	}
+	return modules;
+}
+
+std::vector<NidFunctionEntry> sorted_nid_functions(const std::vector<NidModule> &modules) {
+	std::vector<NidFunctionEntry> entries;
+	for (size_t i = 0; i < modules.size(); ++i)
+		for (auto &function : modules[i].functions)
+			entries.push_back(NidFunctionEntry{hash_name(function.name.data(), function.name.size()), &function.name,
+				static_cast<uint32_t>(i), function.nid});
+	std::stable_sort(entries.begin(), entries.end(), [](const NidFunctionEntry &a, const NidFunctionEntry &b) {
+		return a.hash != b.hash ? a.hash < b.hash : *a.name < *b.name;
+	});
+	return entries;
+}
+
+void CompiledNidDb::Write(const std::vector<NidModule> &modules, const std::vector<NidLibrary> &libraries, const std::string &path) {
+	std::string strings, module_table, function_table;
+	for (auto &module : modules) {
+		write_le32(&module_table, module.nid);
+		write_le32(&module_table, strings.size());
+		write_le32(&module_table, module.name.size());
+		strings += module.name;
+	}
+
+	auto entries = sorted_nid_functions(modules);
+	for (auto &entry : entries) {
+		write_le32(&function_table, entry.hash);
+		write_le32(&function_table, strings.size());
+		write_le32(&function_table, entry.name->size());
+		write_le32(&function_table, entry.module);
+		write_le32(&function_table, entry.nid);
+		strings += *entry.name;
+	}
+
+	std::string library_table;
+	for (auto &library : libraries) {
+		write_le32(&library_table, static_cast<uint32_t>(library.hash));
+		write_le32(&library_table, static_cast<uint32_t>(library.hash >> 32));
+		write_le32(&library_table, library.module_count);
+	}
+
+	uint32_t functions_offset = NidDbHeaderSize + module_table.size();
+	uint32_t libraries_offset = functions_offset + function_table.size();
+	std::string image(NidDbMagic, sizeof(NidDbMagic));
+	write_le32(&image, NidDbVersion);
+	write_le32(&image, modules.size());
+	write_le32(&image, entries.size());
+	write_le32(&image, libraries.size());
+	write_le32(&image, NidDbHeaderSize);
+	write_le32(&image, functions_offset);
+	write_le32(&image, libraries_offset);
+	write_le32(&image, libraries_offset + library_table.size());
+	write_le32(&image, strings.size());
+	image += module_table;
+	image += function_table;
+	image += library_table;
+	image += strings;
+
+	// Leave the file alone when nothing changed, so it does not look modified to build systems
+	write_file_if_changed(path, image);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mappedfile.h"
+
+struct NidFunction {
+	std::string name;
+	uint32_t nid;
+};
+
+struct NidModule {
+	std::string name;
+	uint32_t nid;
+	std::vector<NidFunction> functions;
+};
+
+// A function in the hashed tables of compiled and built-in databases
+struct NidFunctionEntry {
+	uint32_t hash; // hash_name() of the name
+	const std::string *name;
+	uint32_t module; // index of the module it belongs to
+	uint32_t nid;
+};
+
+// Every function of `modules` in table order, by hash and then by name.
+// Stable, so that among duplicate names the first one in the database is
+// found first. Names point into `modules`.
+std::vector<NidFunctionEntry> sorted_nid_functions(const std::vector<NidModule> &modules);
+
+enum class NidFormat {
+	Compiled, // see CompiledNidDb
+	Xml,
+	Text,     // see nidtext.h
+};
+
+// Tells the database formats apart by looking at the contents of `path`
+NidFormat detect_nid_format(const std::string &path);
+
+// Large databases are split at <library> boundaries and parsed on `jobs` threads
+std::vector<NidModule> read_nids_xml(const std::string &path, unsigned jobs = 1);
+// See nidtext.h for the format
+std::vector<NidModule> read_nids_text(const std::string &path);
+// Reads a database in any of the formats open_nid_database accepts
+std::vector<NidModule> read_nid_modules(const std::string &path, unsigned jobs = 1);
+
+// Compiles `xml_path` (or a text database) into `output_path`. If `output_path` already holds a
+// compiled database, libraries whose XML text is unchanged are copied from it
+// and only the edited ones are parsed again. Returns the number of libraries
+// that had to be parsed.
+size_t compile_nid_database(const std::string &xml_path, const std::string &output_path, unsigned jobs = 1);
+
+struct NidMatch {
+	std::string module_name;
+	uint32_t module_nid;
+	uint32_t nid;
+};
+
+class NidDatabase {
+public:
+	virtual ~NidDatabase() {}
+	// Finds the module and NID of function `name`; when several modules export
+	// the same name the first one in the database wins.
+	virtual bool Lookup(const std::string &name, NidMatch *match) const = 0;
+};
+
+// Picks the right loader (compiled, XML or text) for `path` by looking at its contents
+std::unique_ptr<NidDatabase> open_nid_database(const std::string &path, unsigned jobs = 1);
+
+/**
+ * \brief Several databases stacked on top of each other
+ *
+ * Later databases override earlier ones. When a looked up name resolves
+ * differently in more than one database, the conflict is reported on
+ * stderr.
+ */
+class NidOverlay : public NidDatabase {
+public:
+	void Add(const std::string &name, std::unique_ptr<NidDatabase> db);
+	// Errors from a layer are rethrown prefixed with its name
+	bool Lookup(const std::string &name, NidMatch *match) const override;
+private:
+	bool LayerLookup(size_t layer, const std::string &name, NidMatch *match) const;
+	std::vector<std::pair<std::string, std::unique_ptr<NidDatabase>>> layers;
+};
+
+/**
+ * \brief In-memory NID database with a hash index over function names
+ */
+class NidIndex : public NidDatabase {
+public:
+	explicit NidIndex(std::vector<NidModule> modules_);
+	bool Lookup(const std::string &name, NidMatch *match) const override;
+private:
+	std::vector<NidModule> modules;
+	// name -> (module, function) indices
+	std::unordered_map<std::string, std::pair<uint32_t, uint32_t>> index;
+};
+
+// A top-level <library> of the XML database, as recorded in a compiled one
+struct NidLibrary {
+	uint64_t hash; // of the library's XML text
+	uint32_t module_count;
+};
+
+/**
+ * \brief Binary NID database produced by `vitalink --compile-db`
+ *
+ * The file is mapped and queried in place: functions are kept sorted by
+ * name hash, so a lookup is a binary search plus a name compare and the
+ * cost of opening the database does not depend on its size.
+ *
+ * Modules are stored library by library together with a hash of each
+ * library's XML text, which lets a rebuild keep what did not change.
+ */
+class CompiledNidDb : public NidDatabase {
+public:
+	explicit CompiledNidDb(const std::string &path);
+	static bool IsCompiled(const char *data, size_t size);
+	// `libraries` may be empty, otherwise their module counts add up to modules.size()
+	static void Write(const std::vector<NidModule> &modules, const std::vector<NidLibrary> &libraries, const std::string &path);
+	bool Lookup(const std::string &name, NidMatch *match) const override;
+	std::vector<NidLibrary> Libraries() const;
+	// Functions come back in name hash order, which keeps duplicates in database order
+	std::vector<NidModule> Modules() const;
+private:
+	const char *String(uint32_t offset, uint32_t length) const;
+	MappedFile file;
+	const char *data;
+	uint32_t module_count;
+	uint32_t function_count;
+	uint32_t library_count;
+	uint32_t modules_offset;
+	uint32_t functions_offset;
+	uint32_t libraries_offset;
+	uint32_t strings_offset;
+	uint32_t strings_size;
+};
@@ -0,0 +1,72 @@
+// Build-time helper: turns a NID database into the tables behind
+// builtin_nid_database(), see VITALINK_BUILTIN_NIDS in CMakeLists.txt
+
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "niddb.h"
+#include "utility.h"
+
+static void append_string(std::string *output, const std::string &value) {
+	output->push_back('"');
+	for (unsigned char c : value) {
+		if (c == '"' || c == '\\') {
+			output->push_back('\\');
+			output->push_back(c);
+		} else if (c < 0x20 || c >= 0x7f || c == '?') {
+			// octal escapes always take three digits so they cannot swallow the next character,
+			// and '?' is escaped to rule out trigraphs
+			char escape[5];
+			snprintf(escape, sizeof(escape), "\\%03o", c);
+			*output += escape;
+		} else {
+			output->push_back(c);
+		}
+	}
+	output->push_back('"');
+}
+
+static std::string generate_table(const std::vector<NidModule> &modules) {
+	// same order as a compiled database: the first of several equal names is found first
+	auto entries = sorted_nid_functions(modules);
+
+	std::string output = "// Generated by nidgen, do not edit\n\n";
+	output += "static const size_t builtin_module_count = " + std::to_string(modules.size()) + ";\n";
+	output += "static constexpr BuiltinNidModule builtin_modules[] = {\n";
+	for (auto &module : modules) {
+		output += "\t{ ";
+		append_string(&output, module.name);
+		output += ", " + std::to_string(module.name.size()) + ", " + std::to_string(module.nid) + "u },\n";
+	}
+	output += "\t{ nullptr, 0, 0 },\n};\n\n";
+
+	output += "static const size_t builtin_function_count = " + std::to_string(entries.size()) + ";\n";
+	output += "static constexpr BuiltinNidFunction builtin_functions[] = {\n";
+	for (auto &entry : entries) {
+		output += "\t{ " + std::to_string(entry.hash) + "u, ";
+		append_string(&output, *entry.name);
+		output += ", " + std::to_string(entry.name->size()) + ", " + std::to_string(entry.module) + ", "
+			+ std::to_string(entry.nid) + "u },\n";
+	}
+	output += "\t{ 0, nullptr, 0, 0, 0 },\n};\n";
+	return output;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		std::cerr << "Usage: nidgen NIDS.xml|NIDS.txt|NIDS.vdb builtin_nids_table.h" << std::endl;
+		return 1;
+	}
+
+	try {
+		// always written: an output older than the database would make every build rerun nidgen
+		write_file_atomic(argv[2], generate_table(read_nid_modules(argv[1], default_jobs())));
+	} catch (const std::runtime_error &e) {
+		std::cerr << argv[1] << ": " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
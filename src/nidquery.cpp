@@ -0,0 +1,139 @@
+#include "nidquery.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+
+#include "builtinnids.h"
+#include "utility.h"
+
+NidQuery::NidQuery(std::vector<NidModule> modules_):
+	modules(std::move(modules_))
+{
+	size_t count = 0;
+	for (auto &module : modules)
+		count += module.functions.size();
+	by_name.reserve(count);
+	by_nid.reserve(count);
+
+	for (auto &module : modules)
+		for (auto &function : module.functions) {
+			Hit hit = { &module, &function };
+			by_name[function.name].push_back(hit);
+			by_nid[function.nid].push_back(hit);
+		}
+}
+
+const std::vector<NidQuery::Hit> &NidQuery::FindName(const std::string &name) const {
+	auto found = by_name.find(name);
+	return found == by_name.end() ? none : found->second;
+}
+
+const std::vector<NidQuery::Hit> &NidQuery::FindNid(uint32_t nid) const {
+	auto found = by_nid.find(nid);
+	return found == by_nid.end() ? none : found->second;
+}
+
+static void print_query_usage() {
+	std::cout << "Usage: vitalink nid [--nids NIDS.xml]... [--builtin-nids] name2nid [NAME...]" << std::endl;
+	std::cout << "       vitalink nid [--nids NIDS.xml]... [--builtin-nids] nid2name [NID...]" << std::endl;
+	std::cout << "Without arguments after name2nid/nid2name, queries are read from stdin, one per line." << std::endl;
+}
+
+static void append_hit(std::string *output, const std::string &query, const NidQuery::Hit &hit) {
+	char nids[48];
+	snprintf(nids, sizeof(nids), "0x%08X", hit.function->nid);
+	*output += query;
+	*output += ' ';
+	*output += nids;
+	*output += ' ';
+	*output += hit.function->name;
+	snprintf(nids, sizeof(nids), " 0x%08X ", hit.module->nid);
+	*output += nids;
+	*output += hit.module->name;
+	*output += '\n';
+}
+
+int run_nid_query(int argc, char *argv[]) {
+	std::vector<std::string> nids_paths;
+	bool builtin = false;
+	int i = 2;
+	for (; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--nids" && i + 1 < argc)
+			nids_paths.push_back(argv[++i]);
+		else if (arg == "--builtin-nids")
+			builtin = true;
+		else
+			break;
+	}
+	if (i == argc || (nids_paths.empty() && !builtin)) {
+		print_query_usage();
+		return 1;
+	}
+	std::string mode = argv[i++];
+	if (mode != "name2nid" && mode != "nid2name") {
+		print_query_usage();
+		return 1;
+	}
+
+	std::vector<NidModule> modules;
+	if (builtin) {
+		require_builtin_nid_database();
+		modules = builtin_nid_modules();
+	}
+	std::vector<std::future<std::vector<NidModule>>> dbs;
+	for (auto &path : nids_paths)
+		dbs.push_back(std::async(std::launch::async, read_nid_modules, path, default_jobs()));
+	for (size_t j = 0; j < dbs.size(); ++j) {
+		try {
+			auto db = dbs[j].get();
+			std::move(db.begin(), db.end(), std::back_inserter(modules));
+		} catch (const std::runtime_error &e) {
+			std::cerr << nids_paths[j] << ": " << e.what() << std::endl;
+			return 1;
+		}
+	}
+	NidQuery query(std::move(modules));
+
+	std::vector<std::string> queries(argv + i, argv + argc);
+	if (queries.empty()) {
+		std::string line;
+		while (std::getline(std::cin, line)) {
+			size_t begin = line.find_first_not_of(" \t\r");
+			if (begin == std::string::npos)
+				continue;
+			queries.push_back(line.substr(begin, line.find_last_not_of(" \t\r") + 1 - begin));
+		}
+	}
+
+	// answers are printed as "query nid name module_nid module", one line per match
+	int status = 0;
+	std::string output;
+	for (auto &text : queries) {
+		const std::vector<NidQuery::Hit> *hits;
+		if (mode == "name2nid") {
+			hits = &query.FindName(text);
+		} else {
+			uint32_t nid;
+			if (!parse_hex_nid(text.data(), text.size(), &nid)) {
+				std::cerr << text << ": not a NID" << std::endl;
+				status = 1;
+				continue;
+			}
+			hits = &query.FindNid(nid);
+		}
+		if (hits->empty()) {
+			std::cerr << text << ": not found" << std::endl;
+			status = 1;
+		}
+		for (auto &hit : *hits)
+			append_hit(&output, text, hit);
+	}
+	std::cout << output << std::flush;
+	return status;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "niddb.h"
+
+/**
+ * \brief Function names and NIDs indexed in both directions
+ *
+ * Meant for looking up many names or NIDs against whole databases, e.g.
+ * every NID in a crash log. Unlike NidDatabase::Lookup, every match is
+ * reported, in database order.
+ */
+class NidQuery {
+public:
+	struct Hit {
+		const NidModule *module;
+		const NidFunction *function;
+	};
+
+	explicit NidQuery(std::vector<NidModule> modules_);
+	const std::vector<Hit> &FindName(const std::string &name) const;
+	const std::vector<Hit> &FindNid(uint32_t nid) const;
+private:
+	std::vector<NidModule> modules;
+	std::unordered_map<std::string, std::vector<Hit>> by_name;
+	std::unordered_map<uint32_t, std::vector<Hit>> by_nid;
+	std::vector<Hit> none;
+};
+
+// `vitalink nid ...`, returns the exit status
+int run_nid_query(int argc, char *argv[]);
@@ -0,0 +1,144 @@
+#include "nidtext.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utility.h"
+
+static bool is_delimiter(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Returns the first space, tab, CR or LF in [p, end), or end
+static const char *find_delimiter(const char *p, const char *end) {
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)));
+		unsigned mask = _mm_movemask_epi8(hits);
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while (p < end && !is_delimiter(*p))
+		++p;
+	return p;
+}
+
+// Returns the first LF in [p, end), or end
+static const char *find_newline(const char *p, const char *end) {
+#ifdef __SSE2__
+	const __m128i lf = _mm_set1_epi8('\n');
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lf));
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '\n')
+		++p;
+	return p;
+}
+
+namespace {
+
+class NidTextParser {
+public:
+	NidTextParser(const char *text, size_t size, std::vector<NidModule> *modules_):
+		p(text),
+		end(text + size),
+		line(0),
+		modules(modules_)
+	{}
+
+	void Parse() {
+		while (p < end) {
+			++line;
+			const char *line_end = find_newline(p, end);
+			SkipBlanks(line_end);
+			if (p < line_end && *p != '#' && *p != '\r')
+				ParseLine(line_end);
+			p = line_end + (line_end < end);
+		}
+	}
+
+private:
+	void ParseLine(const char *line_end) {
+		uint32_t module_nid = Nid(Field(line_end, "module NID"));
+		auto module_name = Field(line_end, "module name");
+		uint32_t nid = Nid(Field(line_end, "function NID"));
+		auto name = Field(line_end, "function name");
+		if (p < line_end && *p != '\r')
+			Fail("unexpected text after the function name");
+
+		if (modules->empty() || modules->back().nid != module_nid
+				|| modules->back().name.compare(0, std::string::npos, module_name.first, module_name.second) != 0)
+			modules->push_back(NidModule{std::string(module_name.first, module_name.second), module_nid, {}});
+		modules->back().functions.push_back(NidFunction{std::string(name.first, name.second), nid});
+	}
+
+	// Returns the next field on the line and moves past the blanks after it
+	std::pair<const char*, size_t> Field(const char *line_end, const char *what) {
+		const char *field = p;
+		p = find_delimiter(p, line_end);
+		if (p == field)
+			Fail(std::string("missing ") + what);
+		size_t length = p - field;
+		SkipBlanks(line_end);
+		return std::make_pair(field, length);
+	}
+
+	void SkipBlanks(const char *line_end) {
+		while (p < line_end && (*p == ' ' || *p == '\t'))
+			++p;
+	}
+
+	uint32_t Nid(std::pair<const char*, size_t> field) {
+		uint32_t nid;
+		if (!parse_hex_nid(field.first, field.second, &nid))
+			Fail("invalid nid");
+		return nid;
+	}
+
+	[[noreturn]] void Fail(const std::string &message) const {
+		throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+	}
+
+	const char *p;
+	const char *end;
+	size_t line;
+	std::vector<NidModule> *modules;
+};
+
+}
+
+void parse_nids_text(const char *text, size_t size, std::vector<NidModule> *modules) {
+	NidTextParser parser(text, size, modules);
+	parser.Parse();
+}
+
+bool is_nids_xml(const char *text, size_t size) {
+	size_t i = 0;
+	// UTF-8 byte order mark
+	if (size >= 3 && memcmp(text, "\xef\xbb\xbf", 3) == 0)
+		i = 3;
+	while (i < size && is_delimiter(text[i]))
+		++i;
+	return i < size && text[i] == '<';
+}
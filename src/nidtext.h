@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "niddb.h"
+
+// Parser for the line-oriented database format, one function per line:
+//
+//   module_nid module_name func_nid func_name
+//
+// Fields are separated by spaces or tabs, NIDs are hexadecimal with an
+// optional 0x prefix. Empty lines and lines starting with '#' are ignored.
+// Consecutive lines with the same module form one module. Throws
+// std::runtime_error with the line number on malformed input.
+void parse_nids_text(const char *text, size_t size, std::vector<NidModule> *modules);
+
+// True if `text` looks like an XML database rather than a text one
+bool is_nids_xml(const char *text, size_t size);
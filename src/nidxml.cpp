@@ -0,0 +1,267 @@
+#include "nidxml.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "utility.h"
+
+static bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_name_end(char c) {
+	return is_space(c) || c == '>' || c == '/';
+}
+
+namespace {
+
+struct Tag {
+	enum Kind {
+		Open,  // <name ...>
+		Close, // </name>
+		Empty, // <name .../>
+		Other, // comments, <?xml ?>, <!DOCTYPE>, CDATA
+	};
+
+	Kind kind;
+	const char *begin;
+	const char *name;
+	size_t name_length;
+	const char *attributes;
+	const char *attributes_end;
+
+	bool Is(const char *other) const {
+		return name_length == strlen(other) && memcmp(name, other, name_length) == 0;
+	}
+};
+
+class NidXmlParser {
+public:
+	NidXmlParser(const char *text, size_t size, NidXmlVisitor *visitor_):
+		begin(text),
+		p(text),
+		end(text + size),
+		visitor(visitor_)
+	{}
+
+	void Parse() {
+		Tag tag;
+		while (NextTag(&tag)) {
+			if (tag.kind == Tag::Other)
+				continue;
+			if (tag.kind == Tag::Close)
+				Fail(tag.begin, "unexpected closing tag");
+
+			if (tag.Is("library")) {
+				if (tag.kind == Tag::Open)
+					ParseLibrary(tag);
+			} else {
+				SkipElement(tag);
+			}
+		}
+	}
+
+private:
+	void ParseLibrary(const Tag &library) {
+		Tag tag;
+		for (;;) {
+			if (!NextTag(&tag))
+				Fail(library.begin, "<library> is never closed");
+			if (tag.kind == Tag::Other)
+				continue;
+			if (tag.kind == Tag::Close) {
+				if (!tag.Is("library"))
+					Fail(tag.begin, "mismatched closing tag, expected </library>");
+				return;
+			}
+
+			if (tag.Is("module")) {
+				const char *name;
+				size_t length;
+				if (!Attribute(tag, "name", &name, &length))
+					Fail(tag.begin, "<module> without a name attribute");
+				visitor->Module(name, length, Nid(tag));
+				if (tag.kind == Tag::Open)
+					ParseModule(tag);
+			} else {
+				SkipElement(tag);
+			}
+		}
+	}
+
+	void ParseModule(const Tag &module) {
+		Tag tag;
+		for (;;) {
+			if (!NextTag(&tag))
+				Fail(module.begin, "<module> is never closed");
+			if (tag.kind == Tag::Other)
+				continue;
+			if (tag.kind == Tag::Close) {
+				if (!tag.Is("module"))
+					Fail(tag.begin, "mismatched closing tag, expected </module>");
+				return;
+			}
+
+			if (tag.Is("func")) {
+				const char *name;
+				size_t length;
+				if (!Attribute(tag, "name", &name, &length))
+					Fail(tag.begin, "<func> without a name attribute");
+				visitor->Function(name, length, Nid(tag));
+			}
+			SkipElement(tag);
+		}
+	}
+
+	// Consumes everything up to the end of `tag`'s element without looking inside
+	void SkipElement(const Tag &tag) {
+		if (tag.kind != Tag::Open)
+			return;
+		Tag inner;
+		for (int depth = 1; depth; ) {
+			if (!NextTag(&inner))
+				Fail(tag.begin, "element is never closed");
+			if (inner.kind == Tag::Open)
+				++depth;
+			else if (inner.kind == Tag::Close)
+				--depth;
+		}
+	}
+
+	// Moves past the next tag, skipping any text before it. Returns false at the end of input.
+	bool NextTag(Tag *tag) {
+		if (p == end)
+			return false;
+		p = static_cast<const char*>(memchr(p, '<', end - p));
+		if (!p) {
+			p = end;
+			return false;
+		}
+		tag->begin = p;
+
+		if (StartsWith("<!--"))
+			return SkipPast(tag, "-->");
+		if (StartsWith("<![CDATA["))
+			return SkipPast(tag, "]]>");
+		if (StartsWith("<?"))
+			return SkipPast(tag, "?>");
+		if (StartsWith("<!"))
+			return SkipPast(tag, ">");
+
+		bool closing = p + 1 < end && p[1] == '/';
+		p += closing ? 2 : 1;
+		tag->name = p;
+		while (p < end && !is_name_end(*p))
+			++p;
+		tag->name_length = p - tag->name;
+		if (!tag->name_length)
+			Fail(tag->begin, "expected a tag name");
+
+		tag->attributes = p;
+		while (p < end) {
+			char c = *p;
+			if (c == '>') {
+				tag->attributes_end = p++;
+				tag->kind = closing ? Tag::Close : Tag::Open;
+				return true;
+			} else if (c == '/' && p + 1 < end && p[1] == '>') {
+				if (closing)
+					Fail(tag->begin, "malformed closing tag");
+				tag->attributes_end = p;
+				p += 2;
+				tag->kind = Tag::Empty;
+				return true;
+			} else if (c == '"' || c == '\'') {
+				const char *quote = static_cast<const char*>(memchr(p + 1, c, end - p - 1));
+				if (!quote)
+					Fail(p, "unterminated attribute value");
+				p = quote + 1;
+			} else {
+				++p;
+			}
+		}
+		Fail(tag->begin, "unterminated tag");
+	}
+
+	bool StartsWith(const char *prefix) const {
+		size_t length = strlen(prefix);
+		return static_cast<size_t>(end - p) >= length && memcmp(p, prefix, length) == 0;
+	}
+
+	bool SkipPast(Tag *tag, const char *terminator) {
+		const char *found = std::search(p, end, terminator, terminator + strlen(terminator));
+		if (found == end)
+			Fail(tag->begin, "unterminated markup");
+		p = found + strlen(terminator);
+		tag->kind = Tag::Other;
+		tag->name = nullptr;
+		tag->name_length = 0;
+		return true;
+	}
+
+	bool Attribute(const Tag &tag, const char *name, const char **value, size_t *length) {
+		size_t name_length = strlen(name);
+		const char *a = tag.attributes;
+		for (;;) {
+			while (a < tag.attributes_end && is_space(*a))
+				++a;
+			if (a >= tag.attributes_end)
+				return false;
+
+			const char *attribute = a;
+			while (a < tag.attributes_end && *a != '=' && !is_space(*a))
+				++a;
+			size_t attribute_length = a - attribute;
+			while (a < tag.attributes_end && is_space(*a))
+				++a;
+			if (a >= tag.attributes_end || *a != '=')
+				Fail(attribute, "attribute without a value");
+			++a;
+			while (a < tag.attributes_end && is_space(*a))
+				++a;
+			if (a >= tag.attributes_end || (*a != '"' && *a != '\''))
+				Fail(attribute, "attribute value is not quoted");
+
+			const char *quote = static_cast<const char*>(memchr(a + 1, *a, tag.attributes_end - a - 1));
+			if (!quote)
+				Fail(attribute, "unterminated attribute value");
+			if (attribute_length == name_length && memcmp(attribute, name, name_length) == 0) {
+				*value = a + 1;
+				*length = quote - a - 1;
+				return true;
+			}
+			a = quote + 1;
+		}
+	}
+
+	// Decodes the nid="0x..." attribute of `tag` straight from the buffer
+	uint32_t Nid(const Tag &tag) {
+		const char *value;
+		size_t length;
+		if (!Attribute(tag, "nid", &value, &length))
+			Fail(tag.begin, "missing nid attribute");
+		uint32_t nid;
+		if (!parse_hex_nid(value, length, &nid))
+			Fail(value, "invalid nid");
+		return nid;
+	}
+
+	[[noreturn]] void Fail(const char *at, const std::string &message) const {
+		size_t line = 1 + std::count(begin, at, '\n');
+		throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+	}
+
+	const char *begin;
+	const char *p;
+	const char *end;
+	NidXmlVisitor *visitor;
+};
+
+}
+
+void parse_nids_xml(const char *text, size_t size, NidXmlVisitor *visitor) {
+	NidXmlParser parser(text, size, visitor);
+	parser.Parse();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \brief Receives the contents of a NID database as it is parsed
+ *
+ * Names point into the parsed buffer and are not NUL-terminated.
+ */
+class NidXmlVisitor {
+public:
+	virtual ~NidXmlVisitor() {}
+	virtual void Module(const char *name, size_t length, uint32_t nid) = 0;
+	virtual void Function(const char *name, size_t length, uint32_t nid) = 0;
+};
+
+// Forward-only parser for <library>/<module>/<func> databases. No DOM is
+// built and everything else (<description>, <args>, <struct>, ...) is
+// skipped without being looked at. Throws std::runtime_error with the line
+// number on malformed input.
+void parse_nids_xml(const char *text, size_t size, NidXmlVisitor *visitor);
@@ -0,0 +1,184 @@
+#include "sha1.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const uint32_t Sha1Init[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+static const uint32_t Sha1K[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+
+static size_t block_count(size_t size) {
+	// the message, a 0x80 byte and the 64-bit bit length, rounded up to whole blocks
+	return (size + 8) / 64 + 1;
+}
+
+// Big-endian words of block `index` of the padded message
+static void load_block(const char *data, size_t size, size_t index, uint32_t w[16]) {
+	unsigned char block[64] = {};
+	size_t offset = index * 64;
+	if (offset < size)
+		memcpy(block, data + offset, std::min<size_t>(64, size - offset));
+	if (size >= offset && size - offset < 64)
+		block[size - offset] = 0x80;
+	if (index == block_count(size) - 1) {
+		uint64_t bits = uint64_t(size) * 8;
+		for (int i = 0; i < 8; ++i)
+			block[63 - i] = static_cast<unsigned char>(bits >> (i * 8));
+	}
+	for (int i = 0; i < 16; ++i)
+		w[i] = (uint32_t(block[i * 4]) << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+}
+
+static uint32_t rotl(uint32_t x, int n) {
+	return (x << n) | (x >> (32 - n));
+}
+
+static void compress(uint32_t state[5], const uint32_t block[16]) {
+	uint32_t w[80];
+	std::copy(block, block + 16, w);
+	for (int i = 16; i < 80; ++i)
+		w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	for (int i = 0; i < 80; ++i) {
+		uint32_t f;
+		if (i < 20)
+			f = d ^ (b & (c ^ d));
+		else if (i < 40 || i >= 60)
+			f = b ^ c ^ d;
+		else
+			f = (b & c) | (d & (b | c));
+		uint32_t t = rotl(a, 5) + f + e + Sha1K[i / 20] + w[i];
+		e = d;
+		d = c;
+		c = rotl(b, 30);
+		b = a;
+		a = t;
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+static void store_digest(const uint32_t state[5], Sha1Digest *digest) {
+	for (int i = 0; i < 5; ++i)
+		for (int j = 0; j < 4; ++j)
+			digest->bytes[i * 4 + j] = static_cast<unsigned char>(state[i] >> (24 - j * 8));
+}
+
+Sha1Digest sha1(const char *data, size_t size) {
+	uint32_t state[5];
+	std::copy(Sha1Init, Sha1Init + 5, state);
+	uint32_t block[16];
+	for (size_t i = 0, blocks = block_count(size); i < blocks; ++i) {
+		load_block(data, size, i, block);
+		compress(state, block);
+	}
+	Sha1Digest digest;
+	store_digest(state, &digest);
+	return digest;
+}
+
+#ifdef __SSE2__
+
+static __m128i rotl4(__m128i x, int n) {
+	return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n));
+}
+
+// The compression function over four independent messages, lane i of every vector belonging to message i
+static void compress4(__m128i state[5], const __m128i block[16]) {
+	__m128i w[80];
+	std::copy(block, block + 16, w);
+	for (int i = 16; i < 80; ++i)
+		w[i] = rotl4(_mm_xor_si128(_mm_xor_si128(w[i - 3], w[i - 8]), _mm_xor_si128(w[i - 14], w[i - 16])), 1);
+
+	__m128i a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	for (int i = 0; i < 80; ++i) {
+		__m128i f;
+		if (i < 20)
+			f = _mm_xor_si128(d, _mm_and_si128(b, _mm_xor_si128(c, d)));
+		else if (i < 40 || i >= 60)
+			f = _mm_xor_si128(_mm_xor_si128(b, c), d);
+		else
+			f = _mm_or_si128(_mm_and_si128(b, c), _mm_and_si128(d, _mm_or_si128(b, c)));
+		__m128i t = _mm_add_epi32(_mm_add_epi32(rotl4(a, 5), f),
+			_mm_add_epi32(_mm_add_epi32(e, _mm_set1_epi32(Sha1K[i / 20])), w[i]));
+		e = d;
+		d = c;
+		c = rotl4(b, 30);
+		b = a;
+		a = t;
+	}
+	state[0] = _mm_add_epi32(state[0], a);
+	state[1] = _mm_add_epi32(state[1], b);
+	state[2] = _mm_add_epi32(state[2], c);
+	state[3] = _mm_add_epi32(state[3], d);
+	state[4] = _mm_add_epi32(state[4], e);
+}
+
+// Hashes up to four messages at once. Lanes whose message has fewer
+// blocks than the longest one keep their state once they are done.
+static void sha1_x4(const std::string *messages, size_t count, Sha1Digest *digests) {
+	size_t blocks[4] = {}, max_blocks = 0;
+	for (size_t lane = 0; lane < count; ++lane) {
+		blocks[lane] = block_count(messages[lane].size());
+		max_blocks = std::max(max_blocks, blocks[lane]);
+	}
+
+	__m128i state[5];
+	for (int i = 0; i < 5; ++i)
+		state[i] = _mm_set1_epi32(Sha1Init[i]);
+
+	for (size_t index = 0; index < max_blocks; ++index) {
+		alignas(16) uint32_t words[16][4] = {};
+		alignas(16) uint32_t active[4] = {};
+		for (size_t lane = 0; lane < count; ++lane) {
+			if (index >= blocks[lane])
+				continue;
+			uint32_t w[16];
+			load_block(messages[lane].data(), messages[lane].size(), index, w);
+			for (int i = 0; i < 16; ++i)
+				words[i][lane] = w[i];
+			active[lane] = ~0u;
+		}
+
+		__m128i block[16], previous[5];
+		for (int i = 0; i < 16; ++i)
+			block[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(words[i]));
+		std::copy(state, state + 5, previous);
+		compress4(state, block);
+
+		__m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(active));
+		for (int i = 0; i < 5; ++i)
+			state[i] = _mm_or_si128(_mm_and_si128(mask, state[i]), _mm_andnot_si128(mask, previous[i]));
+	}
+
+	alignas(16) uint32_t lanes[5][4];
+	for (int i = 0; i < 5; ++i)
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes[i]), state[i]);
+	for (size_t lane = 0; lane < count; ++lane) {
+		uint32_t lane_state[5];
+		for (int i = 0; i < 5; ++i)
+			lane_state[i] = lanes[i][lane];
+		store_digest(lane_state, &digests[lane]);
+	}
+}
+
+void sha1_batch(const std::string *messages, size_t count, Sha1Digest *digests) {
+	for (size_t i = 0; i < count; i += 4)
+		sha1_x4(messages + i, std::min<size_t>(4, count - i), digests + i);
+}
+
+#else
+
+void sha1_batch(const std::string *messages, size_t count, Sha1Digest *digests) {
+	for (size_t i = 0; i < count; ++i)
+		digests[i] = sha1(messages[i].data(), messages[i].size());
+}
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct Sha1Digest {
+	unsigned char bytes[20];
+};
+
+Sha1Digest sha1(const char *data, size_t size);
+
+// Hashes messages[0..count) into digests[0..count). With SSE2, four
+// messages go through the compression function side by side, which is
+// several times faster than one by one for short messages such as symbol
+// names.
+void sha1_batch(const std::string *messages, size_t count, Sha1Digest *digests);
@@ -1,17 +1,29 @@
+#include <cstddef>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <stdexcept>
 #include <string>
-#include <set>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include "rapidxml.hpp"
-
+#include "archive.h"
+#include "cache.h"
+#include "derive.h"
 #include "elf.h"
+#include "elfwriter.h"
+#include "mappedfile.h"
+#include "niddb.h"
+#include "symbolset.h"
 #include "utility.h"
+#include "vitastructs.h"
 
-std::set<std::string> g_undefined_symbols;
+// Names referenced but not defined by the inputs, filled in by scan_files
+SymbolSet g_undefined_symbols;
 
 const std::string g_stubs_template = R"(
 .macro STUB name
@@ -25,6 +37,10 @@ NOP
 .code 32
 )";
 
+// The same STUB as above, already assembled: mvn r0, #0; bx lr; mov r0, r0
+const uint32_t g_stub_code[] = { 0xE3E00000, 0xE12FFF1E, 0xE1A00000 };
+const uint32_t g_module_start_nid = 0x935CD196;
+
 struct ImportedFunc {
 	std::string name;
 	uint32_t nid;
@@ -49,100 +65,363 @@ struct Import {
 
 std::map<uint32_t, Import> g_imports;
 
-void load_nids(char *path) {
-	std::ifstream input(path, std::ios::in);
-	if (!input)
-		throw std::runtime_error(std::string("Cannot open ") + path + " for reading");
-
-	std::streamsize size = stream_size(&input);
-	std::vector<char> text(size + 1);
-	if (!input.read(text.data(), size))
-		throw std::runtime_error(std::string("Cannot read ") + path);
-
-	rapidxml::xml_document<> doc;
-	doc.parse<0>(text.data());
-	for (auto library = doc.first_node(); library; library = library->next_sibling())
-		for (auto module = library->first_node(); module; module = module->next_sibling()) {
-			std::string module_name = module->first_attribute("name")->value();
-			std::string module_nid_str = module->first_attribute("nid")->value();
-			uint32_t module_nid = strtoul(module_nid_str.substr(2).c_str(), NULL, 16);
-
-			for (auto atom = module->first_node(); atom; atom = atom->next_sibling()) {
-				if (atom->name() == std::string("func")) {
-					std::string name = atom->first_attribute("name")->value();
-					std::string nid_str = atom->first_attribute("nid")->value();
-					uint32_t nid = strtoul(nid_str.substr(2).c_str(), NULL, 16);
-
-					if (g_undefined_symbols.count(name)) {
-						if (!g_imports.count(module_nid))
-							g_imports[module_nid] = Import(module_name, module_nid);
-						g_imports[module_nid].imported_funcs.push_back(ImportedFunc(name, nid));
-					}
-				}
-			}
+static void add_import(const std::string &module_name, uint32_t module_nid, const std::string &name, uint32_t nid) {
+	if (!g_imports.count(module_nid))
+		g_imports[module_nid] = Import(module_name, module_nid);
+	g_imports[module_nid].imported_funcs.push_back(ImportedFunc(name, nid));
+}
+
+void load_nids(const NidDatabase &db, const std::vector<NidDeriveRule> &derive_rules, unsigned jobs) {
+	// drive the lookup from what the objects import, not from the database
+	NidMatch match;
+	std::vector<std::vector<std::string>> derive(derive_rules.size());
+	for (auto symbol : g_undefined_symbols.Sorted()) {
+		std::string name(symbol);
+		if (db.Lookup(name, &match)) {
+			add_import(match.module_name, match.module_nid, name, match.nid);
+			continue;
 		}
+		for (size_t i = 0; i < derive_rules.size(); ++i)
+			if (name.compare(0, derive_rules[i].prefix.size(), derive_rules[i].prefix) == 0) {
+				derive[i].push_back(name);
+				break;
+			}
+	}
+
+	for (size_t i = 0; i < derive_rules.size(); ++i) {
+		auto nids = derive_nids(derive[i], derive_rules[i].suffix, jobs);
+		for (size_t j = 0; j < nids.size(); ++j)
+			add_import(derive_rules[i].module_name, derive_rules[i].module_nid, derive[i][j], nids[j]);
+	}
 }
 
-void output_stubs(const char *path) {
-	std::ofstream output(path, std::ios::out);
-	output << g_stubs_template << std::endl;
+void compile_nids(const std::string &xml_path, const std::string &output_path) {
+	compile_nid_database(xml_path, output_path, default_jobs());
+}
 
-	for (auto &i : g_imports)
-		for (auto &function : i.second.imported_funcs)
-			output << "STUB " << function.name << std::endl;
+static void append_hex(std::string *output, uint32_t value) {
+	static const char digits[] = "0123456789abcdef";
+	char buf[8];
+	int n = 0;
+	do {
+		buf[n++] = digits[value & 0xf];
+		value >>= 4;
+	} while (value);
+	while (n)
+		output->push_back(buf[--n]);
+}
 
-	output << std::endl << ".section .sceImport.rodata, \"a\"" << std::endl;
-	for (auto &i : g_imports) {
-		auto &module = i.second;
-		output << module.name << "_name: .string \"" << module.name << "\"" << std::endl;
-	}
+// Tables that do not depend on the imports
+const std::string g_stubs_footer = R"(
+.section .sceModuleInfo.rodata, "a"
+.hword 0x0; .hword 0x101; .string "01234567890123456789012345"; .byte 0x6; .word 0; .word 0; .word 0; .word 0; .word 0; .word 0; .word 0; .word 0; .word 0; .word module_start; .word 0; .word 0; .word 0; .word 0; .word 0;
 
-	output << std::endl << ".section .sceFNID.rodata, \"a\"" << std::endl;
-	for (auto &i : g_imports) {
-		auto &module = i.second;
-		output << module.name << "_nids: ";
-		for (auto &func : module.imported_funcs)
-			output << ".word 0x" << std::hex << func.nid << "; ";
-		output << std::endl;
-	}
+.section .sceExport.rodata, "a"
+export_nids: .word 0x935CD196
+export_funcs: .word module_start
+
+.section .sceLib.ent, "a"
+.hword 0x20; .hword 0; .hword 0x8000; .hword 1; .word 0; .word 0; .word 0; .word 0; .word export_nids; .word export_funcs;
+)";
+
+void output_stubs(const char *path) {
+	// a single pass over the imports fills every section, which are then
+	// joined into one buffer and written out at once
+	std::string stubs, names, nids, funcs, lib_stubs;
+	names = "\n.section .sceImport.rodata, \"a\"\n";
+	nids = "\n.section .sceFNID.rodata, \"a\"\n";
+	funcs = "\n.section .sceFStub.rodata, \"a\"\n";
+	lib_stubs = "\n.section .sceLib.stub, \"a\"\n";
 
-	output << std::endl << ".section .sceFStub.rodata, \"a\"" << std::endl;
 	for (auto &i : g_imports) {
 		auto &module = i.second;
-		output << module.name << "_funcs: ";
-		for (auto &func : module.imported_funcs)
-			output << ".word " << func.name << "; ";
-		output << std::endl;
+		names += module.name + "_name: .string \"" + module.name + "\"\n";
+		nids += module.name + "_nids: ";
+		funcs += module.name + "_funcs: ";
+		for (auto &func : module.imported_funcs) {
+			stubs += "STUB " + func.name + "\n";
+			nids += ".word 0x";
+			append_hex(&nids, func.nid);
+			nids += "; ";
+			funcs += ".word " + func.name + "; ";
+		}
+		nids += "\n";
+		funcs += "\n";
+
+		lib_stubs += ".hword 0x34; .hword 0; .hword 0; .hword " + std::to_string(module.imported_funcs.size())
+			+ "; .hword 0; .hword 0; .word 0; .word 0x";
+		append_hex(&lib_stubs, module.nid);
+		lib_stubs += "; .word " + module.name + "_name; .word 0; .word " + module.name + "_nids; .word "
+			+ module.name + "_funcs; .word 0; .word 0; .word 0; .word 0;\n";
 	}
 
-	output << std::endl << ".section .sceLib.stub, \"a\"" << std::endl;
+	std::string output;
+	output.reserve(g_stubs_template.size() + 1 + stubs.size() + names.size() + nids.size() + funcs.size()
+		+ lib_stubs.size() + g_stubs_footer.size());
+	output += g_stubs_template;
+	output += "\n";
+	output += stubs;
+	output += names;
+	output += nids;
+	output += funcs;
+	output += lib_stubs;
+	output += g_stubs_footer;
+
+	// keep the old file, and its mtime, if nothing changed so make does not reassemble and relink
+	write_file_if_changed(path, output);
+}
+
+void output_stubs_object(const char *path) {
+	ElfWriter elf(EM_ARM, EF_ARM_EABI_VER5);
+	auto text = elf.AddSection(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4);
+	auto import_names = elf.AddSection(".sceImport.rodata", SHT_PROGBITS, SHF_ALLOC, 1);
+	auto nid_tables = elf.AddSection(".sceFNID.rodata", SHT_PROGBITS, SHF_ALLOC, 4);
+	auto func_tables = elf.AddSection(".sceFStub.rodata", SHT_PROGBITS, SHF_ALLOC, 4);
+	auto imports = elf.AddSection(".sceLib.stub", SHT_PROGBITS, SHF_ALLOC, 4);
+	auto module_info_section = elf.AddSection(".sceModuleInfo.rodata", SHT_PROGBITS, SHF_ALLOC, 4);
+	auto export_tables = elf.AddSection(".sceExport.rodata", SHT_PROGBITS, SHF_ALLOC, 4);
+	auto exports = elf.AddSection(".sceLib.ent", SHT_PROGBITS, SHF_ALLOC, 4);
+
+	// ARM ELF mapping symbols: $a marks ARM code, $d marks data
+	elf.AddSymbol("$a", text, 0, STB_LOCAL, STT_NOTYPE);
+	for (auto section : { import_names, nid_tables, func_tables, imports, module_info_section, export_tables, exports })
+		elf.AddSymbol("$d", section, 0, STB_LOCAL, STT_NOTYPE);
+	auto module_start = elf.AddSymbol("module_start", SHN_UNDEF, 0, STB_GLOBAL, STT_NOTYPE);
+
 	for (auto &i : g_imports) {
 		auto &module = i.second;
-		output << ".hword 0x34; .hword 0; .hword 0; .hword " << module.imported_funcs.size() << "; .hword 0; .hword 0; "
-			<< ".word 0; .word 0x" << std::hex << module.nid << "; .word " << module.name << "_name; "
-			<< ".word 0; .word " << module.name << "_nids; .word " << module.name << "_funcs; "
-			<< ".word 0; .word 0; .word 0; .word 0;" << std::endl;
+
+		auto name = elf.AddSymbol(module.name + "_name", import_names, elf.Data(import_names).size(), STB_LOCAL, STT_OBJECT);
+		elf.Data(import_names) += module.name;
+		elf.Data(import_names).push_back('\0');
+
+		auto nids = elf.AddSymbol(module.name + "_nids", nid_tables, elf.Data(nid_tables).size(), STB_LOCAL, STT_OBJECT);
+		auto funcs = elf.AddSymbol(module.name + "_funcs", func_tables, elf.Data(func_tables).size(), STB_LOCAL, STT_OBJECT);
+		for (auto &func : module.imported_funcs) {
+			auto stub = elf.AddSymbol(func.name, text, elf.Data(text).size(), STB_GLOBAL, STT_FUNC);
+			for (auto word : g_stub_code)
+				write_le32(&elf.Data(text), word);
+
+			write_le32(&elf.Data(nid_tables), func.nid);
+			elf.AddRelocation(func_tables, elf.Data(func_tables).size(), stub, R_ARM_ABS32);
+			write_le32(&elf.Data(func_tables), 0);
+		}
+
+		std::string &stub = elf.Data(imports);
+		size_t base = stub.size();
+		stub.resize(base + sizeof(module_imports));
+		put_le16(&stub, base + offsetof(module_imports, size), sizeof(module_imports));
+		put_le16(&stub, base + offsetof(module_imports, num_functions), module.imported_funcs.size());
+		put_le32(&stub, base + offsetof(module_imports, module_nid), module.nid);
+		elf.AddRelocation(imports, base + offsetof(module_imports, module_name), name, R_ARM_ABS32);
+		elf.AddRelocation(imports, base + offsetof(module_imports, func_nid_table), nids, R_ARM_ABS32);
+		elf.AddRelocation(imports, base + offsetof(module_imports, func_entry_table), funcs, R_ARM_ABS32);
 	}
 
-	output << std::endl << ".section .sceModuleInfo.rodata, \"a\"" << std::endl;
-	output << ".hword 0x0; .hword 0x101; .string \"01234567890123456789012345\"; .byte 0x6; .word 0; "
-		<< ".word 0; .word 0; .word 0; .word 0; .word 0; .word 0; .word 0; .word 0; "
-		<< ".word module_start; .word 0; .word 0; .word 0; .word 0; .word 0;" << std::endl;
+	std::string &info = elf.Data(module_info_section);
+	info.resize(sizeof(module_info));
+	put_le16(&info, offsetof(module_info, modversion), 0x101);
+	info.replace(offsetof(module_info, modname), 27, "01234567890123456789012345", 27);
+	info[offsetof(module_info, type)] = 6;
+	elf.AddRelocation(module_info_section, offsetof(module_info, mod_start), module_start, R_ARM_ABS32);
+
+	auto export_nids = elf.AddSymbol("export_nids", export_tables, 0, STB_LOCAL, STT_OBJECT);
+	auto export_funcs = elf.AddSymbol("export_funcs", export_tables, 4, STB_LOCAL, STT_OBJECT);
+	write_le32(&elf.Data(export_tables), g_module_start_nid);
+	elf.AddRelocation(export_tables, 4, module_start, R_ARM_ABS32);
+	write_le32(&elf.Data(export_tables), 0);
 
-	output << std::endl << ".section .sceExport.rodata, \"a\"" << std::endl;
-	output << "export_nids: .word 0x935CD196" << std::endl << 
-		"export_funcs: .word module_start" << std::endl;
+	std::string &ent = elf.Data(exports);
+	ent.resize(sizeof(module_exports));
+	put_le16(&ent, offsetof(module_exports, size), sizeof(module_exports));
+	put_le16(&ent, offsetof(module_exports, flags), 0x8000);
+	put_le16(&ent, offsetof(module_exports, num_functions), 1);
+	elf.AddRelocation(exports, offsetof(module_exports, nid_table), export_nids, R_ARM_ABS32);
+	elf.AddRelocation(exports, offsetof(module_exports, entry_table), export_funcs, R_ARM_ABS32);
 
-	output << std::endl << ".section .sceLib.ent, \"a\"" << std::endl;
-	output << ".hword 0x20; .hword 0; .hword 0x8000; .hword 1; .word 0; .word 0; .word 0; "
-		<< ".word 0; .word export_nids; .word export_funcs;" << std::endl;
+	write_file_if_changed(path, elf.Build());
 }
 
-void process_file(char *path) {
+static std::mutex g_log_mutex;
+
+static void log_error(const std::string &name, const std::string &error) {
+	std::lock_guard<std::mutex> lock(g_log_mutex);
+	std::cerr << name << ": " << error << std::endl;
+}
+
+bool process_object(const std::string &name, const char *data, size_t size, SymbolTables *symbols, unsigned jobs,
+		bool referenced_only) {
 	try {
-		Elf elf(path);
-		elf.GetUndefinedSymbols(&g_undefined_symbols);
+		open_elf(data, size)->GetSymbols(symbols, jobs, referenced_only);
+		return true;
 	} catch (const std::runtime_error &e) {
-		std::cerr << path << ": " << e.what() << std::endl;
+		log_error(name, e.what());
+		return false;
+	}
+}
+
+static std::vector<std::string> sorted_names(const SymbolSet &set) {
+	std::vector<std::string> names;
+	for (auto name : set.Sorted())
+		names.emplace_back(name);
+	return names;
+}
+
+static void intern_cached(const CachedSymbols &cached, SymbolTables *symbols) {
+	for (auto &name : cached.undefined)
+		symbols->undefined.Intern(name);
+	for (auto &name : cached.defined)
+		symbols->defined.Intern(name);
+	for (auto &name : cached.weak)
+		symbols->weak.Intern(name);
+}
+
+struct InputFile {
+	FileStamp stamp;
+	std::unique_ptr<MappedFile> file;
+	std::unique_ptr<Archive> archive;
+	bool cached;
+	CachedSymbols cached_symbols;
+};
+
+struct ScanItem {
+	std::string name;
+	// what the cache knows the item by; members add their offset because
+	// `ar q` lets two of them share a name
+	std::string key;
+	const char *data;
+	size_t size;
+	const FileStamp *stamp;
+};
+
+static ScanItem member_item(const std::string &path, const InputFile &input, const Archive::Member &member) {
+	return ScanItem{path + "(" + member.name + ")", path + "(" + member.name + "@" + std::to_string(member.offset) + ")",
+		member.data, member.size, &input.stamp};
+}
+
+// Adds the symbols of `items` to `all` and returns the undefined ones it had
+// not seen yet, as views into `all`
+static SymbolSet scan_items(const std::vector<ScanItem> &items, unsigned jobs, ScanCache *cache, bool referenced_only,
+		SymbolTables *all) {
+	// every worker collects into its own tables, they are merged once at the end;
+	// names still point into the mapped objects until they are interned there
+	std::vector<SymbolTables> found(jobs);
+	// with fewer objects than threads, the spare threads go to splitting up
+	// the symbol tables of the objects themselves
+	unsigned object_jobs = !items.empty() && items.size() < jobs ? (jobs + items.size() - 1) / items.size() : 1;
+	parallel_for(items.size(), jobs, [&](size_t i, unsigned worker) {
+		auto &item = items[i];
+		if (!cache) {
+			process_object(item.name, item.data, item.size, &found[worker], object_jobs, referenced_only);
+			return;
+		}
+
+		CachedSymbols cached;
+		if (!cache->Find(item.key, *item.stamp, &cached)) {
+			SymbolTables object_symbols;
+			if (!process_object(item.name, item.data, item.size, &object_symbols, object_jobs, referenced_only))
+				return;
+			cached.undefined = sorted_names(object_symbols.undefined);
+			cached.defined = sorted_names(object_symbols.defined);
+			cached.weak = sorted_names(object_symbols.weak);
+			cache->Store(item.key, *item.stamp, cached);
+		}
+		intern_cached(cached, &found[worker]);
+	});
+
+	SymbolSet added;
+	for (auto &tables : found) {
+		for (auto &entry : tables.undefined.Entries())
+			if (all->undefined.Intern(entry))
+				added.Insert(all->undefined.Entries().back());
+		all->defined.Merge(tables.defined);
+		all->weak.Merge(tables.weak);
+	}
+	return added;
+}
+
+void scan_files(const std::vector<std::string> &paths, unsigned jobs, ScanCache *cache, bool referenced_only) {
+	// map every input and split archives into members, so that one big
+	// archive is spread over all workers just like a list of objects;
+	// objects the cache already knows about are not even opened
+	std::vector<InputFile> inputs(paths.size());
+	parallel_for(paths.size(), jobs, [&](size_t i, unsigned) {
+		auto &input = inputs[i];
+		input.cached = false;
+		try {
+			if (cache) {
+				input.stamp = stamp_file(paths[i]);
+				if (cache->Find(paths[i], input.stamp, &input.cached_symbols)) {
+					input.cached = true;
+					return;
+				}
+			}
+			input.file.reset(new MappedFile(paths[i]));
+			if (Archive::IsArchive(input.file->Data(), input.file->Size()))
+				input.archive.reset(new Archive(input.file->Data(), input.file->Size()));
+		} catch (const std::runtime_error &e) {
+			input.file.reset();
+			log_error(paths[i], e.what());
+		}
+	});
+
+	// archives with a symbol index are resolved lazily below, the rest is scanned upfront
+	SymbolTables symbols;
+	std::vector<ScanItem> items;
+	std::unordered_map<std::string, std::pair<size_t, size_t>> archive_symbols;
+	for (size_t i = 0; i < paths.size(); ++i) {
+		auto &input = inputs[i];
+		if (input.cached) {
+			intern_cached(input.cached_symbols, &symbols);
+		} else if (input.archive && !input.archive->Symbols().empty()) {
+			// like ld, the first archive on the command line that defines a symbol wins
+			for (auto &symbol : input.archive->Symbols())
+				archive_symbols.emplace(symbol.name, std::make_pair(i, symbol.member));
+		} else if (input.archive) {
+			for (auto &member : input.archive->Members())
+				items.push_back(member_item(paths[i], input, member));
+		} else if (input.file) {
+			items.push_back(ScanItem{paths[i], paths[i], input.file->Data(), input.file->Size(), &input.stamp});
+		}
+	}
+
+	// everything is new at this point, including symbols from cached inputs
+	scan_items(items, jobs, cache, referenced_only, &symbols);
+	SymbolSet pending;
+	for (auto &entry : symbols.undefined.Entries())
+		pending.Insert(entry);
+
+	// Pull in only the archive members that define a symbol we still need, then
+	// repeat with whatever those members reference until nothing new shows up.
+	// Like ld, a symbol some object already defines, even weakly, pulls nothing.
+	std::set<std::pair<size_t, size_t>> pulled;
+	while (!pending.Empty()) {
+		items.clear();
+		for (auto &entry : pending.Entries()) {
+			if (symbols.defined.Contains(entry.name) || symbols.weak.Contains(entry.name))
+				continue;
+			auto symbol = archive_symbols.find(std::string(entry.name));
+			if (symbol == archive_symbols.end() || !pulled.insert(symbol->second).second)
+				continue;
+			auto &input = inputs[symbol->second.first];
+			items.push_back(member_item(paths[symbol->second.first], input, input.archive->Members()[symbol->second.second]));
+		}
+
+		pending = scan_items(items, jobs, cache, referenced_only, &symbols);
+	}
+
+	// Whatever an input defines is resolved by the linker and must not get a
+	// stub. Weak definitions do not count: a stub's definition would override
+	// them at link time anyway, so they still get one.
+	for (auto &entry : symbols.undefined.Entries())
+		if (!symbols.defined.Contains(entry.name))
+			g_undefined_symbols.Intern(entry);
+
+	if (cache) {
+		try {
+			cache->Save();
+		} catch (const std::runtime_error &e) {
+			log_error("cache", e.what());
+		}
 	}
 }
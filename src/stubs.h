@@ -1,5 +1,24 @@
 #pragma once
 
-void process_file(char *path);
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class NidDatabase;
+struct NidDeriveRule;
+class ScanCache;
+struct SymbolTables;
+
+// Adds the symbols of an object to `symbols`, as views into `data`; `jobs`
+// threads share the work if the object has a very large symbol table
+bool process_object(const std::string &name, const char *data, size_t size, SymbolTables *symbols, unsigned jobs = 1,
+	bool referenced_only = false);
+// With `referenced_only`, a symbol is only imported if some relocation uses it
+void scan_files(const std::vector<std::string> &paths, unsigned jobs, ScanCache *cache = nullptr, bool referenced_only = false);
 void output_stubs(const char *path);
-void load_nids(char *path);
+void output_stubs_object(const char *path);
+// Symbols missing from `db` get a computed NID from the first rule whose prefix
+// they match, derived on up to `jobs` threads
+void load_nids(const NidDatabase &db, const std::vector<NidDeriveRule> &derive_rules = std::vector<NidDeriveRule>(),
+	unsigned jobs = 1);
+void compile_nids(const std::string &xml_path, const std::string &output_path);
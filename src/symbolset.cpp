@@ -0,0 +1,89 @@
+#include "symbolset.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "utility.h"
+
+static const size_t ArenaBlockSize = 64 * 1024;
+static const size_t InitialSlots = 256;
+
+std::string_view StringArena::Store(std::string_view text) {
+	if (text.size() > left) {
+		// oversized strings get a block of their own, the current one stays in use
+		if (text.size() > ArenaBlockSize / 4) {
+			blocks.emplace_back(new char[text.size()]);
+			memcpy(blocks.back().get(), text.data(), text.size());
+			return std::string_view(blocks.back().get(), text.size());
+		}
+		blocks.emplace_back(new char[ArenaBlockSize]);
+		next = blocks.back().get();
+		left = ArenaBlockSize;
+	}
+	char *stored = next;
+	memcpy(stored, text.data(), text.size());
+	next += text.size();
+	left -= text.size();
+	return std::string_view(stored, text.size());
+}
+
+uint32_t SymbolSet::Hash(std::string_view name) {
+	return hash_name(name.data(), name.size());
+}
+
+bool SymbolSet::Add(std::string_view name, uint32_t hash, bool copy) {
+	if ((entries.size() + 1) * 2 > slots.size())
+		Grow();
+
+	size_t mask = slots.size() - 1;
+	for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+		uint32_t index = slots[slot];
+		if (!index) {
+			entries.push_back(Entry{copy ? arena.Store(name) : name, hash});
+			slots[slot] = entries.size();
+			return true;
+		}
+		const Entry &entry = entries[index - 1];
+		if (entry.hash == hash && entry.name == name)
+			return false;
+	}
+}
+
+void SymbolSet::Grow() {
+	std::vector<uint32_t> grown(std::max(InitialSlots, slots.size() * 2), 0);
+	size_t mask = grown.size() - 1;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		size_t slot = entries[i].hash & mask;
+		while (grown[slot])
+			slot = (slot + 1) & mask;
+		grown[slot] = i + 1;
+	}
+	slots.swap(grown);
+}
+
+void SymbolSet::Merge(const SymbolSet &other) {
+	for (auto &entry : other.entries)
+		Intern(entry);
+}
+
+bool SymbolSet::Contains(std::string_view name) const {
+	if (slots.empty())
+		return false;
+	uint32_t hash = Hash(name);
+	size_t mask = slots.size() - 1;
+	for (size_t slot = hash & mask; slots[slot]; slot = (slot + 1) & mask) {
+		const Entry &entry = entries[slots[slot] - 1];
+		if (entry.hash == hash && entry.name == name)
+			return true;
+	}
+	return false;
+}
+
+std::vector<std::string_view> SymbolSet::Sorted() const {
+	std::vector<std::string_view> names;
+	names.reserve(entries.size());
+	for (auto &entry : entries)
+		names.push_back(entry.name);
+	std::sort(names.begin(), names.end());
+	return names;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * \brief Append-only storage for strings that live as long as the arena
+ *
+ * Strings are copied into large blocks, so storing one is a pointer bump
+ * instead of a heap allocation, and returned views stay valid until the
+ * arena is destroyed.
+ */
+class StringArena {
+public:
+	std::string_view Store(std::string_view text);
+private:
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char *next = nullptr;
+	size_t left = 0;
+};
+
+/**
+ * \brief Set of symbol names with hashes computed once per name
+ *
+ * Open addressing with linear probing over a table of entry indices; the
+ * stored hash is compared before the name, so a probe rarely touches the
+ * string itself. Insert() keeps the caller's view, which must outlive the
+ * set (e.g. a name in a mapped .strtab), while Intern() copies new names
+ * into the set's own arena. Either way a name already in the set costs one
+ * probe and no allocation. Not thread-safe: give each thread its own set
+ * and Merge() them.
+ */
+class SymbolSet {
+public:
+	struct Entry {
+		std::string_view name;
+		uint32_t hash;
+	};
+
+	// Both return true if the name was not in the set yet
+	bool Insert(std::string_view name) { return Add(name, Hash(name), false); }
+	bool Intern(std::string_view name) { return Add(name, Hash(name), true); }
+	// With a hash computed earlier, e.g. on another thread
+	bool Insert(const Entry &entry) { return Add(entry.name, entry.hash, false); }
+	bool Intern(const Entry &entry) { return Add(entry.name, entry.hash, true); }
+	void Merge(const SymbolSet &other);
+
+	bool Contains(std::string_view name) const;
+	bool Empty() const { return entries.empty(); }
+	size_t Size() const { return entries.size(); }
+	// In insertion order
+	const std::vector<Entry> &Entries() const { return entries; }
+	// Sorted by name, for output that does not depend on scan order
+	std::vector<std::string_view> Sorted() const;
+
+	static uint32_t Hash(std::string_view name);
+private:
+	bool Add(std::string_view name, uint32_t hash, bool copy);
+	void Grow();
+
+	std::vector<Entry> entries;
+	std::vector<uint32_t> slots; // entry index + 1, 0 when free
+	StringArena arena;
+};
+
+// What one or more objects reference and define
+struct SymbolTables {
+	SymbolSet undefined;
+	SymbolSet defined; // global definitions
+	SymbolSet weak;    // weak definitions
+};
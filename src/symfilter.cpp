@@ -0,0 +1,106 @@
+#include "symfilter.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SYMFILTER_X86 1
+#endif
+
+static_assert(sizeof(Elf32_Sym) == 16, "Elf32_Sym must be 16 bytes");
+
+// The last word of an Elf32_Sym holds st_info (low byte), st_other and
+// st_shndx (high half). A symbol is undefined when the type bits of st_info
+// and all of st_shndx are zero, and defined when st_shndx is not zero.
+static const uint32_t UndefinedMask = 0xFFFF000F;
+static const uint32_t SectionMask = 0xFFFF0000;
+
+static void filter_scalar(const Elf32_Sym *symbols, size_t first, size_t last, std::vector<uint32_t> *undefined,
+		std::vector<uint32_t> *defined) {
+	for (size_t i = first; i < last; ++i) {
+		if (symbols[i].st_shndx != SHN_UNDEF)
+			defined->push_back(i);
+		else if (symbols[i].getType() == STT_NOTYPE)
+			undefined->push_back(i);
+	}
+}
+
+#ifdef SYMFILTER_X86
+
+static void push_matches(unsigned mask, size_t base, std::vector<uint32_t> *indices) {
+	while (mask) {
+		indices->push_back(base + __builtin_ctz(mask));
+		mask &= mask - 1;
+	}
+}
+
+// Four symbols per step: the last words are gathered into one vector with
+// two rounds of unpacks, masked and compared against zero.
+static size_t filter_sse2(const Elf32_Sym *symbols, size_t first, size_t last, std::vector<uint32_t> *undefined,
+		std::vector<uint32_t> *defined) {
+	const __m128i undefined_mask = _mm_set1_epi32(UndefinedMask);
+	const __m128i section_mask = _mm_set1_epi32(SectionMask);
+	const __m128i zero = _mm_setzero_si128();
+	const char *base = reinterpret_cast<const char*>(symbols);
+	size_t i = first;
+	for (; last - i >= 4; i += 4) {
+		const char *p = base + i * 16;
+		__m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+		__m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+		__m128i s3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48));
+		__m128i words = _mm_unpackhi_epi64(_mm_unpackhi_epi32(s0, s1), _mm_unpackhi_epi32(s2, s3));
+		__m128i undefined_hits = _mm_cmpeq_epi32(_mm_and_si128(words, undefined_mask), zero);
+		__m128i no_section = _mm_cmpeq_epi32(_mm_and_si128(words, section_mask), zero);
+		push_matches(_mm_movemask_ps(_mm_castsi128_ps(undefined_hits)), i, undefined);
+		push_matches(~_mm_movemask_ps(_mm_castsi128_ps(no_section)) & 0xf, i, defined);
+	}
+	return i;
+}
+
+// Same as filter_sse2, eight symbols per step. Unpacks work within 128-bit
+// lanes, so the gathered words come out as 0 2 4 6 1 3 5 7 and are put
+// back in order before the mask is taken.
+__attribute__((target("avx2")))
+static size_t filter_avx2(const Elf32_Sym *symbols, size_t first, size_t last, std::vector<uint32_t> *undefined,
+		std::vector<uint32_t> *defined) {
+	const __m256i undefined_mask = _mm256_set1_epi32(UndefinedMask);
+	const __m256i section_mask = _mm256_set1_epi32(SectionMask);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	const char *base = reinterpret_cast<const char*>(symbols);
+	size_t i = first;
+	for (; last - i >= 8; i += 8) {
+		const char *p = base + i * 16;
+		__m256i s01 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		__m256i s23 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+		__m256i s45 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 64));
+		__m256i s67 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 96));
+		__m256i words = _mm256_unpackhi_epi64(_mm256_unpackhi_epi32(s01, s23), _mm256_unpackhi_epi32(s45, s67));
+		words = _mm256_permutevar8x32_epi32(words, order);
+		__m256i undefined_hits = _mm256_cmpeq_epi32(_mm256_and_si256(words, undefined_mask), zero);
+		__m256i no_section = _mm256_cmpeq_epi32(_mm256_and_si256(words, section_mask), zero);
+		push_matches(_mm256_movemask_ps(_mm256_castsi256_ps(undefined_hits)), i, undefined);
+		push_matches(~_mm256_movemask_ps(_mm256_castsi256_ps(no_section)) & 0xff, i, defined);
+	}
+	return i;
+}
+
+static bool has_avx2() {
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+#endif
+
+void find_global_symbols(const Elf32_Sym *symbols, size_t first, size_t last, std::vector<uint32_t> *undefined,
+		std::vector<uint32_t> *defined) {
+	if (first >= last)
+		return;
+#ifdef SYMFILTER_X86
+	if (has_avx2())
+		first = filter_avx2(symbols, first, last, undefined, defined);
+	first = filter_sse2(symbols, first, last, undefined, defined);
+#endif
+	filter_scalar(symbols, first, last, undefined, defined);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "elftypes.h"
+
+// Sorts the symbols in [first, last) of `symbols`, in increasing index
+// order: `undefined` gets those that are undefined (SHN_UNDEF) and have no
+// type (STT_NOTYPE), `defined` those with a section index (any other
+// SHN_*). Symbols are checked several at a time with AVX2 or SSE2 when the
+// CPU has them.
+void find_global_symbols(const Elf32_Sym *symbols, size_t first, size_t last, std::vector<uint32_t> *undefined,
+	std::vector<uint32_t> *defined);
@@ -1,8 +1,178 @@
 #include "utility.h"
 
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
 std::streamsize stream_size(std::ifstream *input) {
 	input->seekg(0, std::ios::end);
 	std::streamsize size = input->tellg();
 	input->seekg(0, std::ios::beg);
 	return size;
-}
\ No newline at end of file
+}
+
+unsigned default_jobs() {
+	unsigned jobs = std::thread::hardware_concurrency();
+	return jobs ? jobs : 1;
+}
+
+void parallel_for(size_t count, unsigned jobs, const std::function<void(size_t, unsigned)> &fn) {
+	if (jobs > count)
+		jobs = count;
+	if (jobs <= 1) {
+		for (size_t i = 0; i < count; ++i)
+			fn(i, 0);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto worker = [&](unsigned id) {
+		for (size_t i; (i = next++) < count; ) {
+			try {
+				fn(i, id);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+				next = count;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned id = 1; id < jobs; ++id)
+		threads.emplace_back(worker, id);
+	worker(0);
+	for (auto &thread : threads)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+// FNV-1a, stored in compiled databases so it must never change
+uint32_t hash_name(const char *name, size_t length) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= static_cast<unsigned char>(name[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint64_t hash_text(const char *text, size_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= static_cast<unsigned char>(text[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+int hex_digit(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+bool parse_hex_nid(const char *text, size_t length, uint32_t *nid) {
+	if (length > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+		text += 2;
+		length -= 2;
+	}
+	if (!length || length > 8)
+		return false;
+	uint32_t value = 0;
+	for (size_t i = 0; i < length; ++i) {
+		int digit = hex_digit(text[i]);
+		if (digit < 0)
+			return false;
+		value = (value << 4) | digit;
+	}
+	*nid = value;
+	return true;
+}
+
+uint32_t read_le32(const char *p) {
+	const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+	return u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+void write_le16(std::string *output, uint16_t value) {
+	output->push_back(static_cast<char>(value));
+	output->push_back(static_cast<char>(value >> 8));
+}
+
+void write_le32(std::string *output, uint32_t value) {
+	for (int i = 0; i < 4; ++i)
+		output->push_back(static_cast<char>(value >> (8 * i)));
+}
+
+void put_le16(std::string *output, size_t offset, uint16_t value) {
+	(*output)[offset] = static_cast<char>(value);
+	(*output)[offset + 1] = static_cast<char>(value >> 8);
+}
+
+void put_le32(std::string *output, size_t offset, uint32_t value) {
+	for (int i = 0; i < 4; ++i)
+		(*output)[offset + i] = static_cast<char>(value >> (8 * i));
+}
+
+void write_file_atomic(const std::string &path, const std::string &contents) {
+	// a unique name next to `path`, so that concurrent writers never share a
+	// temporary file and rename() stays within one file system
+	std::string tmp_path = path + ".XXXXXX";
+	int fd = mkstemp(&tmp_path[0]);
+	if (fd < 0)
+		throw std::runtime_error("Cannot create a temporary file for " + path);
+
+	// mkstemp creates the file 0600, give it the usual permissions instead
+	mode_t mask = umask(0);
+	umask(mask);
+	bool ok = fchmod(fd, 0666 & ~mask) == 0;
+	for (size_t written = 0; ok && written < contents.size(); ) {
+		ssize_t n = write(fd, contents.data() + written, contents.size() - written);
+		if (n < 0 && errno == EINTR)
+			continue;
+		ok = n > 0;
+		written += ok ? n : 0;
+	}
+	if (close(fd) != 0)
+		ok = false;
+	if (!ok) {
+		unlink(tmp_path.c_str());
+		throw std::runtime_error("Cannot write " + path);
+	}
+	if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+		unlink(tmp_path.c_str());
+		throw std::runtime_error("Cannot replace " + path);
+	}
+}
+
+bool write_file_if_changed(const std::string &path, const std::string &contents) {
+	{
+		std::ifstream input(path.c_str(), std::ios::in | std::ios::binary);
+		if (input && stream_size(&input) == static_cast<std::streamsize>(contents.size())) {
+			std::string current(contents.size(), '\0');
+			if (input.read(&current[0], current.size()) && current == contents)
+				return false;
+		}
+	}
+	write_file_atomic(path, contents);
+	return true;
+}
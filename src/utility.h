@@ -1,5 +1,36 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <functional>
+#include <string>
 
 std::streamsize stream_size(std::ifstream *input);
+
+unsigned default_jobs();
+// Calls fn(index, worker) for every index in [0, count) on up to `jobs` threads.
+// `worker` is in [0, jobs) and lets callers keep per-thread state without locking.
+// The first exception thrown by fn is rethrown once all workers have stopped.
+void parallel_for(size_t count, unsigned jobs, const std::function<void(size_t, unsigned)> &fn);
+
+uint32_t hash_name(const char *name, size_t length);
+// 64-bit FNV-1a, for content fingerprints
+uint64_t hash_text(const char *text, size_t length);
+// Value of hex digit `c`, or -1
+int hex_digit(char c);
+// Decodes a NID written as 1 to 8 hex digits after an optional 0x. Signs,
+// blanks and anything wider than 32 bits are rejected.
+bool parse_hex_nid(const char *text, size_t length, uint32_t *nid);
+
+uint32_t read_le32(const char *p);
+void write_le16(std::string *output, uint16_t value);
+void write_le32(std::string *output, uint32_t value);
+// Overwrite bytes already in `output`
+void put_le16(std::string *output, size_t offset, uint16_t value);
+void put_le32(std::string *output, size_t offset, uint32_t value);
+
+// Writes through a temporary file and renames it over `path`
+void write_file_atomic(const std::string &path, const std::string &contents);
+// Like write_file_atomic, but leaves `path` untouched if it already has `contents`
+bool write_file_if_changed(const std::string &path, const std::string &contents);
@@ -1,37 +1,195 @@
+#include <algorithm>
+#include <cstdlib>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
+#include <sys/stat.h>
+
+#include "builtinnids.h"
+#include "cache.h"
+#include "derive.h"
 #include "elf.h"
+#include "niddb.h"
+#include "nidquery.h"
 #include "stubs.h"
+#include "utility.h"
 
 void fixup_elf(int argc, char *argv[]) {
 	try {
-		Elf elf(argv[2]);
-		elf.FixupTopEnd();
-		elf.Write(argv[2]);
+		auto elf = open_elf(argv[2], MappedFile::Mode::ReadWrite);
+		elf->FixupTopEnd();
+		elf->Flush();
 	} catch (const std::runtime_error &e) {
 		std::cerr << e.what() << std::endl;
 		exit(1);
 	}
 }
 
-void generate_stubs(int argc, char *argv[]) {
-	for (int i = 2; i < argc; ++i)
-		process_file(argv[i]);
+void print_usage() {
+	std::cout << "Usage: vitalink [-j N] [--cache FILE] [--referenced-only] [-o __stubs.S|__stubs.o] [--derive RULE]... NIDS.xml|NIDS.txt|NIDS.vdb object.o..." << std::endl;
+	std::cout << "       vitalink [options] --nids NIDS.xml [--nids NIDS.xml]... object.o..." << std::endl;
+	std::cout << "       vitalink [options] --builtin-nids [--nids NIDS.xml]... object.o..." << std::endl;
+	std::cout << "       vitalink --fixup homebrew.elf" << std::endl;
+	std::cout << "       vitalink --compile-db NIDS.xml NIDS.vdb" << std::endl;
+	std::cout << "       vitalink --derive-db [-j N] RULE NAMES.txt NIDS.txt" << std::endl;
+	std::cout << "       vitalink nid [--nids NIDS.xml]... name2nid|nid2name [NAME|NID...]" << std::endl;
+	std::cout << "RULE is MODULE:MODULE_NID:SUFFIX[:PREFIX], see README.md" << std::endl;
+}
+
+void compile_db(int argc, char *argv[]) {
+	if (argc != 4) {
+		print_usage();
+		exit(1);
+	}
 
 	try {
-		load_nids(argv[1]);
+		compile_nids(argv[2], argv[3]);
 	} catch (const std::runtime_error &e) {
 		std::cerr << argv[2] << ": " << e.what() << std::endl;
 		exit(1);
 	}
+}
 
-	output_stubs("__stubs.S");
+// Parses the -jN or -j N option at argv[*i], moving *i past a separate value
+static unsigned parse_jobs(int argc, char *argv[], int *i) {
+	std::string arg = argv[*i];
+	std::string value = arg.size() > 2 ? arg.substr(2) : (*i + 1 < argc ? argv[++*i] : "");
+	unsigned jobs = strtoul(value.c_str(), NULL, 10);
+	if (!jobs) {
+		std::cerr << "Invalid number of jobs: " << value << std::endl;
+		exit(1);
+	}
+	return jobs;
 }
 
-void print_usage() {
-	std::cout << "Usage: vitalink NIDS.xml object.o..." << std::endl;
-	std::cout << "       vitalink --fixup homebrew.elf" << std::endl;
+void derive_db(int argc, char *argv[]) {
+	unsigned jobs = default_jobs();
+	std::vector<std::string> args;
+	for (int i = 2; i < argc; ++i) {
+		if (std::string(argv[i]).compare(0, 2, "-j") == 0)
+			jobs = parse_jobs(argc, argv, &i);
+		else
+			args.push_back(argv[i]);
+	}
+	if (args.size() != 3) {
+		print_usage();
+		exit(1);
+	}
+
+	NidDeriveRule rule;
+	try {
+		rule = parse_derive_rule(args[0]);
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << std::endl;
+		exit(1);
+	}
+
+	try {
+		write_derived_nids(rule, args[1], args[2], jobs);
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << std::endl;
+		exit(1);
+	}
+}
+
+// True if both paths name the same existing file
+static bool same_file(const std::string &a, const std::string &b) {
+	struct stat sa, sb;
+	return stat(a.c_str(), &sa) == 0 && stat(b.c_str(), &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+void generate_stubs(int argc, char *argv[]) {
+	unsigned jobs = default_jobs();
+	std::unique_ptr<ScanCache> cache;
+	std::string cache_path;
+	bool referenced_only = false;
+	std::string output = "__stubs.S";
+	std::vector<std::string> inputs, nids_paths;
+	std::unique_ptr<NidDatabase> builtin;
+	std::vector<NidDeriveRule> derive_rules;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--nids" && i + 1 < argc) {
+			nids_paths.push_back(argv[++i]);
+		} else if (arg == "--builtin-nids") {
+			builtin = require_builtin_nid_database();
+		} else if (arg == "--derive" && i + 1 < argc) {
+			try {
+				derive_rules.push_back(parse_derive_rule(argv[++i]));
+			} catch (const std::runtime_error &e) {
+				std::cerr << e.what() << std::endl;
+				exit(1);
+			}
+		} else if (arg == "-o" && i + 1 < argc) {
+			output = argv[++i];
+		} else if (arg == "--cache" && i + 1 < argc) {
+			cache_path = argv[++i];
+		} else if (arg == "--referenced-only") {
+			referenced_only = true;
+		} else if (arg.compare(0, 2, "-j") == 0) {
+			jobs = parse_jobs(argc, argv, &i);
+		} else {
+			inputs.push_back(arg);
+		}
+	}
+
+	// without --nids the first input is the database
+	if (nids_paths.empty() && !builtin && !inputs.empty()) {
+		nids_paths.push_back(inputs[0]);
+		inputs.erase(inputs.begin());
+	}
+	if (inputs.empty()) {
+		print_usage();
+		exit(1);
+	}
+
+	// the output of an earlier run, e.g. picked up by *.o, is about to be replaced and defines nothing
+	inputs.erase(std::remove_if(inputs.begin(), inputs.end(), [&](const std::string &input) {
+		return same_file(input, output);
+	}), inputs.end());
+
+	if (!cache_path.empty())
+		cache.reset(new ScanCache(cache_path, referenced_only ? "referenced-only" : "all"));
+
+	// the databases do not depend on the objects or on each other, parse them while the objects are scanned
+	std::vector<std::future<std::unique_ptr<NidDatabase>>> dbs;
+	for (auto &path : nids_paths)
+		dbs.push_back(std::async(std::launch::async, open_nid_database, path, jobs));
+	scan_files(inputs, jobs, cache.get(), referenced_only);
+
+	NidOverlay overlay;
+	// the built-in database is the bottom layer, any --nids file can override it
+	if (builtin)
+		overlay.Add("built-in database", std::move(builtin));
+	for (size_t i = 0; i < dbs.size(); ++i) {
+		try {
+			overlay.Add(nids_paths[i], dbs[i].get());
+		} catch (const std::runtime_error &e) {
+			std::cerr << nids_paths[i] << ": " << e.what() << std::endl;
+			exit(1);
+		}
+	}
+	try {
+		load_nids(overlay, derive_rules, jobs);
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << std::endl;
+		exit(1);
+	}
+
+	try {
+		// an object file can be linked directly, without going through the assembler
+		if (output.size() > 2 && output.compare(output.size() - 2, 2, ".o") == 0)
+			output_stubs_object(output.c_str());
+		else
+			output_stubs(output.c_str());
+	} catch (const std::runtime_error &e) {
+		std::cerr << output << ": " << e.what() << std::endl;
+		exit(1);
+	}
 }
 
 int main(int argc, char *argv[]) {
@@ -40,8 +198,15 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
+	if (argv[1] == std::string("nid"))
+		return run_nid_query(argc, argv);
+
 	if (argv[1] == std::string("--fixup"))
 		fixup_elf(argc, argv);
+	else if (argv[1] == std::string("--compile-db"))
+		compile_db(argc, argv);
+	else if (argv[1] == std::string("--derive-db"))
+		derive_db(argc, argv);
 	else
 		generate_stubs(argc, argv);
 
@@ -30,3 +30,43 @@ struct module_info // thanks roxfan
     uint32_t   extab_start;   //
     uint32_t   extab_end;     //
 };
+
+/**
+ * \brief Import list entry (.sceLib.stub), one per imported module
+ */
+struct module_imports
+{
+    uint16_t   size;             // sizeof(module_imports) = 0x34
+    uint16_t   version;
+    uint16_t   flags;
+    uint16_t   num_functions;
+    uint16_t   num_vars;
+    uint16_t   num_tls_vars;
+    uint32_t   reserved1;
+    uint32_t   module_nid;
+    uint32_t   module_name;      // pointer to the name of the imported module
+    uint32_t   reserved2;
+    uint32_t   func_nid_table;   // NIDs of the imported functions
+    uint32_t   func_entry_table; // stubs the loader patches, same order as the NIDs
+    uint32_t   var_nid_table;
+    uint32_t   var_entry_table;
+    uint32_t   tls_nid_table;
+    uint32_t   tls_entry_table;
+};
+
+/**
+ * \brief Export list entry (.sceLib.ent)
+ */
+struct module_exports
+{
+    uint16_t   size;             // sizeof(module_exports) = 0x20
+    uint16_t   version;
+    uint16_t   flags;            // 0x8000 for the main module export
+    uint16_t   num_functions;
+    uint32_t   num_vars;
+    uint32_t   num_tls_vars;
+    uint32_t   module_nid;
+    uint32_t   module_name;
+    uint32_t   nid_table;
+    uint32_t   entry_table;
+};
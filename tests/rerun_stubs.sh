@@ -0,0 +1,26 @@
+#!/bin/sh
+# Running vitalink again over *.o picks up the __stubs.o of the previous run.
+# Its stubs must not count as definitions, or the new __stubs.o loses them.
+#
+# usage: rerun_stubs.sh VITALINK CC WORKDIR
+set -e
+vitalink=$1
+cc=$2
+dir=$3
+
+rm -rf "$dir"
+mkdir -p "$dir"
+cd "$dir"
+
+printf '0x12345678 SceIoFilemgrForUser 0xDEADBEEF sceIoOpen\n' > nids.txt
+printf 'int sceIoOpen(const char *, int, int);\nint main(void) { return sceIoOpen("", 0, 0); }\n' > main.c
+"$cc" -c main.c -o main.o
+
+# the -o output is replaced, not read
+"$vitalink" -o __stubs.o nids.txt main.o
+"$vitalink" -o __stubs.o nids.txt main.o __stubs.o
+grep -q sceIoOpen __stubs.o
+
+# and an object with import tables defines nothing
+"$vitalink" -o stubs.S nids.txt main.o __stubs.o
+grep -q '^STUB sceIoOpen$' stubs.S